@@ -0,0 +1,1160 @@
+#include <fcntl.h>
+#include <time.h>
+
+#include "../src/pnc.h"
+
+// benchmarks for single steps of the pipeline
+// usage: build/bench [name prefix], `just bench micro` runs only the
+// microbenchmarks
+// prints one line per measurement as key=value pairs so the output can be
+// diffed and parsed easily
+
+typedef void BenchFn(void);
+
+typedef struct {
+	char* name;
+	BenchFn* fn;
+} Bench;
+
+// best of this many runs is reported
+#define BENCH_REPS 5
+
+static double now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// "(+ 1 (+ 1 (+ 1 ... 1)))" with depth nested calls
+static char* gen_deep(int depth) {
+	char* s = malloc(depth * 6 + depth + 2);
+	char* p = s;
+	for (int i = 0; i < depth; i++) {
+		memcpy(p, "(+ 1 ", 5);
+		p += 5;
+	}
+	*p++ = '1';
+	memset(p, ')', depth);
+	p += depth;
+	*p = '\0';
+	return s;
+}
+
+// "(+ 1 1 1 ... 1)" that is about bytes long
+static char* gen_wide(size_t bytes) {
+	char* s = malloc(bytes + 8);
+	char* p = s;
+	p += sprintf(p, "(+");
+	while ((size_t)(p - s) < bytes) {
+		memcpy(p, " 1", 2);
+		p += 2;
+	}
+	*p++ = ')';
+	*p = '\0';
+	return s;
+}
+
+// "(+ (+ (+ 1 1) ...) ...)", a full binary tree with 2^depth leaves
+static char* gen_balanced(int depth) {
+	if (depth == 0) {
+		return strdup("1");
+	}
+	char* sub = gen_balanced(depth - 1);
+	char* s = malloc(2 * strlen(sub) + 8);
+	sprintf(s, "(+ %s %s)", sub, sub);
+	free(sub);
+	return s;
+}
+
+// tokenize + make_ast, best time of BENCH_REPS runs
+static void run_make_ast(char* name, char* param, char* prog) {
+	double best = 0;
+	int num_tokens = 0;
+
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		double start = now_ns();
+
+		TokenList tl = tokenize(prog);
+		make_ast(tl);
+
+		double t = now_ns() - start;
+		if (rep == 0 || t < best) {
+			best = t;
+		}
+		num_tokens = tl.len;
+		arena_reset(&ctx.arena);
+	}
+
+	printf("bench=%s %s tokens=%d total_ms=%.3f ns_per_token=%.2f\n",
+		name, param, num_tokens, best / 1e6, best / num_tokens);
+}
+
+// string to expr tree, either through parse_str() or through
+// tokenize + make_ast + parse, best time of BENCH_REPS runs
+static void run_front_end(char* name, char* param, char* prog, bool staged) {
+	double best = 0;
+	int len = strlen(prog);
+
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		double start = now_ns();
+
+		if (staged) {
+			parse(make_ast(tokenize(prog)));
+		} else {
+			parse_str(prog);
+		}
+
+		double t = now_ns() - start;
+		if (rep == 0 || t < best) {
+			best = t;
+		}
+		arena_reset(&ctx.arena);
+	}
+
+	printf("bench=%s %s bytes=%d total_ms=%.3f ns_per_byte=%.2f\n",
+		name, param, len, best / 1e6, best / len);
+}
+
+static void bench_make_ast_deep() {
+	int depths[] = { 25000, 50000, 100000 };
+
+	for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+		char* prog = gen_deep(depths[i]);
+		char param[32];
+		sprintf(param, "depth=%d", depths[i]);
+		run_make_ast("make_ast/deep", param, prog);
+		free(prog);
+	}
+}
+
+static void bench_make_ast_wide() {
+	size_t sizes[] = { 2500000, 5000000, 10000000 };
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		char* prog = gen_wide(sizes[i]);
+		char param[32];
+		sprintf(param, "bytes=%zu", sizes[i]);
+		run_make_ast("make_ast/wide", param, prog);
+		free(prog);
+	}
+}
+
+static void bench_front_end_deep() {
+	int depths[] = { 25000, 50000, 100000 };
+
+	for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+		char* prog = gen_deep(depths[i]);
+		char param[32];
+		sprintf(param, "depth=%d", depths[i]);
+		run_front_end("front_end/deep/staged", param, prog, true);
+		run_front_end("front_end/deep/fused", param, prog, false);
+		free(prog);
+	}
+}
+
+static void bench_front_end_wide() {
+	size_t sizes[] = { 1000000, 2000000, 4000000 };
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		char* prog = gen_wide(sizes[i]);
+		char param[32];
+		sprintf(param, "size=%zu", sizes[i]);
+		run_front_end("front_end/wide/staged", param, prog, true);
+		run_front_end("front_end/wide/fused", param, prog, false);
+		free(prog);
+	}
+}
+
+// evaluates prog runs times with the tree walker and with the vm
+// the expr tree and the chunk are only built once
+static void run_eval(char* name, char* param, char* prog, int runs) {
+	Expr* e = parse_str(prog);
+	Chunk c = compile(e);
+
+	// nodes in the tree, same as the number of instructions
+	int nodes = 0;
+	for (int i = 0; i < c.code_len; i += 1 + op_num_operands(c.code[i])) {
+		nodes++;
+	}
+
+	double best_tree = 0;
+	double best_vm = 0;
+
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		double start = now_ns();
+		for (int i = 0; i < runs; i++) {
+			eval(e);
+		}
+		double t = now_ns() - start;
+		if (rep == 0 || t < best_tree) {
+			best_tree = t;
+		}
+
+		start = now_ns();
+		for (int i = 0; i < runs; i++) {
+			vm_run(&c);
+		}
+		t = now_ns() - start;
+		if (rep == 0 || t < best_vm) {
+			best_vm = t;
+		}
+	}
+
+	printf("bench=%s/tree %s nodes=%d ns_per_run=%.1f ns_per_node=%.2f\n",
+		name, param, nodes, best_tree / runs, best_tree / runs / nodes);
+	printf("bench=%s/vm %s nodes=%d ns_per_run=%.1f ns_per_node=%.2f\n",
+		name, param, nodes, best_vm / runs, best_vm / runs / nodes);
+
+	arena_reset(&ctx.arena);
+}
+
+static void bench_eval_deep() {
+	int depths[] = { 10, 100, 1000, 100000 };
+
+	for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+		char* prog = gen_deep(depths[i]);
+		char param[32];
+		sprintf(param, "depth=%d", depths[i]);
+		run_eval("eval/deep", param, prog, max(1, 100000 / depths[i]));
+		free(prog);
+	}
+}
+
+static void bench_eval_balanced() {
+	int depths[] = { 4, 8, 12 };
+
+	for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+		char* prog = gen_balanced(depths[i]);
+		char param[32];
+		sprintf(param, "depth=%d", depths[i]);
+		run_eval("eval/balanced", param, prog, 100000 >> depths[i]);
+		free(prog);
+	}
+}
+
+// adds a and b runs times, each result is cleared right away
+static void run_num_add(char* param, char* a, char* b) {
+	Number n1, n2;
+	num_from_str(a, strlen(a), &n1);
+	num_from_str(b, strlen(b), &n2);
+
+	int runs = 1000000;
+	double best = 0;
+
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		double start = now_ns();
+		for (int i = 0; i < runs; i++) {
+			num_clear(num_add(n1, n2));
+		}
+		double t = now_ns() - start;
+		if (rep == 0 || t < best) {
+			best = t;
+		}
+	}
+
+	printf("bench=num_add/ZZ %s small=%d ns_per_op=%.2f\n",
+		param, n1.is_small && n2.is_small, best / runs);
+
+	num_clear(n1);
+	num_clear(n2);
+}
+
+static void bench_num_add() {
+	run_num_add("operands=small", "12345", "-678");
+	run_num_add("operands=overflow", "9223372036854775807", "1");
+	run_num_add("operands=big",
+		"123456789012345678901234567890", "98765432109876543210");
+}
+
+// folds x into an accumulator runs times, once with num_add() and a fresh
+// result every time, once with num_add_into()
+static void run_fold(char* param, char* acc_str, char* x_str) {
+	Number acc, x;
+	num_from_str(acc_str, strlen(acc_str), &acc);
+	num_from_str(x_str, strlen(x_str), &x);
+
+	int runs = 1000000;
+	double best_add = 0;
+	double best_into = 0;
+	size_t allocs_add = 0;
+	size_t allocs_into = 0;
+
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		Number a = num_small(0);
+		num_set(&a, &acc);
+
+		ctx.gmp_stats = (GmpAllocStats){0};
+		double start = now_ns();
+		for (int i = 0; i < runs; i++) {
+			Number next = num_add(a, x);
+			num_clear(a);
+			a = next;
+		}
+		double t = now_ns() - start;
+		if (rep == 0 || t < best_add) {
+			best_add = t;
+		}
+		allocs_add = ctx.gmp_stats.allocs + ctx.gmp_stats.reallocs;
+
+		num_set(&a, &acc);
+
+		ctx.gmp_stats = (GmpAllocStats){0};
+		start = now_ns();
+		for (int i = 0; i < runs; i++) {
+			num_add_into(&a, &x);
+		}
+		t = now_ns() - start;
+		if (rep == 0 || t < best_into) {
+			best_into = t;
+		}
+		allocs_into = ctx.gmp_stats.allocs + ctx.gmp_stats.reallocs;
+
+		num_clear(a);
+	}
+
+	printf("bench=fold/num_add %s ns_per_op=%.2f allocs_per_op=%.3f\n",
+		param, best_add / runs, (double)allocs_add / runs);
+	printf("bench=fold/num_add_into %s ns_per_op=%.2f allocs_per_op=%.3f\n",
+		param, best_into / runs, (double)allocs_into / runs);
+
+	num_clear(acc);
+	num_clear(x);
+}
+
+static void bench_fold() {
+	run_fold("types=ZZ", "123456789012345678901234567890", "987654321");
+	run_fold("types=QZ", "1/3", "7");
+	run_fold("types=QQ", "1/3", "2/3");
+	run_fold("types=RZ", "0.5", "7");
+	run_fold("types=RQ", "0.5", "1/3");
+	run_fold("types=RR", "0.5", "0.25");
+}
+
+// fib(n) computed from scratch, again right after (memo hit) and for n + 1
+// (one step from the memo entry)
+static void bench_fib() {
+	for (int n = 1000; n <= 10000000; n *= 10) {
+		Value arg = { .type = V_NUM, .number_value = num_small(n) };
+		Value next = { .type = V_NUM, .number_value = num_small(n + 1) };
+
+		double best_cold = 0;
+		double best_hit = 0;
+		double best_near = 0;
+
+		for (int rep = 0; rep < BENCH_REPS; rep++) {
+			fib_memo_clear();
+
+			double start = now_ns();
+			num_clear(e_func_fib(&arg, 1).number_value);
+			double t = now_ns() - start;
+			if (rep == 0 || t < best_cold) {
+				best_cold = t;
+			}
+
+			start = now_ns();
+			num_clear(e_func_fib(&arg, 1).number_value);
+			t = now_ns() - start;
+			if (rep == 0 || t < best_hit) {
+				best_hit = t;
+			}
+
+			start = now_ns();
+			num_clear(e_func_fib(&next, 1).number_value);
+			t = now_ns() - start;
+			if (rep == 0 || t < best_near) {
+				best_near = t;
+			}
+		}
+
+		printf("bench=fib n=%d cold_us=%.1f memo_us=%.1f near_us=%.1f\n",
+			n, best_cold / 1e3, best_hit / 1e3, best_near / 1e3);
+	}
+	fib_memo_clear();
+}
+
+// appends n small integers to a list and sums it
+// a packed list only holds int64_t values, a rational at the front forces
+// the generic layout
+static void run_list(char* layout, int n, bool packed) {
+	double best_append = 0;
+	double best_sum = 0;
+	size_t bytes = 0;
+
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		NumberList nl = nl_new();
+		if (!packed) {
+			Number half;
+			num_from_str("1/2", 3, &half);
+			nl_append(&nl, half);
+		}
+
+		double start = now_ns();
+		for (int i = 0; i < n; i++) {
+			nl_append(&nl, num_small(i));
+		}
+		double t = now_ns() - start;
+		if (rep == 0 || t < best_append) {
+			best_append = t;
+		}
+
+		Value v = { .type = V_LIST, .list_value = nl };
+		start = now_ns();
+		e_func_sum(&v, 1);
+		t = now_ns() - start;
+		if (rep == 0 || t < best_sum) {
+			best_sum = t;
+		}
+
+		bytes = nl.cap * (nl.unpacked ? sizeof(Number) : sizeof(int64_t));
+		arena_reset(&ctx.arena);
+	}
+
+	printf("bench=list layout=%s n=%d ns_per_append=%.2f ns_per_sum_elem=%.2f "
+		"bytes_per_elem=%.1f\n",
+		layout, n, best_append / n, best_sum / n, (double)bytes / n);
+}
+
+static void bench_list() {
+	for (int n = 1000; n <= 10000000; n *= 100) {
+		run_list("packed", n, true);
+		run_list("generic", n, false);
+	}
+}
+
+// elements per second of every kernel set, and of the generic path that
+// adds one Number at a time
+static void run_simd(int n, int runs) {
+	int64_t* a = malloc(sizeof(int64_t) * n);
+	int64_t* b = malloc(sizeof(int64_t) * n);
+	for (int i = 0; i < n; i++) {
+		a[i] = i % 1000 - 500;
+		b[i] = i % 7;
+	}
+
+	char* names[] = { "scalar", "sse2", "avx2" };
+	for (size_t k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+		if (!simd_select(names[k])) {
+			continue;
+		}
+
+		double best[4] = {0};
+		volatile int64_t sink = 0;
+		for (int rep = 0; rep < BENCH_REPS; rep++) {
+			double t[4];
+			int64_t r, lo, hi;
+
+			double start = now_ns();
+			for (int i = 0; i < runs; i++) {
+				simd.sum(a, n, &r);
+				sink += r;
+			}
+			t[0] = now_ns() - start;
+
+			start = now_ns();
+			for (int i = 0; i < runs; i++) {
+				simd.minmax(a, n, &lo, &hi);
+				sink += lo + hi;
+			}
+			t[1] = now_ns() - start;
+
+			start = now_ns();
+			for (int i = 0; i < runs; i++) {
+				sink += simd.count_eq(a, n, 7);
+			}
+			t[2] = now_ns() - start;
+
+			start = now_ns();
+			for (int i = 0; i < runs; i++) {
+				simd.dot(a, b, n, &r);
+				sink += r;
+			}
+			t[3] = now_ns() - start;
+
+			for (int j = 0; j < 4; j++) {
+				if (rep == 0 || t[j] < best[j]) {
+					best[j] = t[j];
+				}
+			}
+		}
+
+		char* kernels[] = { "sum", "minmax", "count_eq", "dot" };
+		for (int j = 0; j < 4; j++) {
+			printf("bench=simd/%s kernels=%s n=%d melems_per_sec=%.1f\n",
+				kernels[j], names[k], n, (double)n * runs / best[j] * 1e3);
+		}
+	}
+
+	// what sum did before lists were packed
+	double best = 0;
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		Number acc = num_small(0);
+		double start = now_ns();
+		for (int i = 0; i < n; i++) {
+			Number x = num_small(a[i]);
+			acc = num_add(acc, x);
+		}
+		double t = now_ns() - start;
+		if (rep == 0 || t < best) {
+			best = t;
+		}
+	}
+	printf("bench=simd/sum kernels=num_add n=%d melems_per_sec=%.1f\n",
+		n, n / best * 1e3);
+
+	simd_init();
+	free(a);
+	free(b);
+}
+
+static void bench_simd() {
+	// fits in l2, then one that has to stream from memory
+	run_simd(32768, 1000);
+	run_simd(4000000, 10);
+}
+
+// sum or prod of v with the given number of threads, best of BENCH_REPS
+static double time_reduce(Value v, bool mul, int threads) {
+	pool_init(threads);
+	double best = 0;
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		double start = now_ns();
+		Value r = mul ? e_func_prod(&v, 1) : e_func_sum(&v, 1);
+		double t = now_ns() - start;
+		num_clear(r.number_value);
+		if (rep == 0 || t < best) {
+			best = t;
+		}
+	}
+	return best;
+}
+
+// the tree reduction against a plain left fold, with one thread and with
+// one per cpu (PNC_THREADS)
+static void bench_reduce() {
+	int cpus = pool_size();
+	int threads[] = { 1, cpus };
+	int num_runs = (cpus > 1) ? 2 : 1;
+
+	// prod of 1..n, the left fold multiplies a growing number by a small one
+	int n = 100000;
+	Value range = e_func_range((Value[]){
+		{ .type = V_NUM, .number_value = num_small(1) },
+		{ .type = V_NUM, .number_value = num_small(n + 1) },
+	}, 2);
+
+	double best_fold = 0;
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		double start = now_ns();
+		Number acc = num_small(1);
+		for (int i = 1; i <= n; i++) {
+			Number x = num_small(i);
+			num_mul_into(&acc, &x);
+		}
+		double t = now_ns() - start;
+		if (rep == 0 || t < best_fold) {
+			best_fold = t;
+		}
+		num_clear(acc);
+	}
+	printf("bench=reduce op=prod_fold n=%d ms=%.2f\n", n, best_fold / 1e6);
+
+	for (int i = 0; i < num_runs; i++) {
+		double t = time_reduce(range, true, threads[i]);
+		printf("bench=reduce op=prod n=%d threads=%d ms=%.2f\n",
+			n, threads[i], t / 1e6);
+	}
+
+	// sum of big integers, each one a few limbs
+	int m = 200000;
+	NumberList nl = nl_new();
+	char buf[64];
+	for (int i = 0; i < m; i++) {
+		snprintf(buf, sizeof(buf), "%d123456789012345678901234567890", i);
+		Number x;
+		num_from_str(buf, strlen(buf), &x);
+		nl_append(&nl, x);
+	}
+	Value list = { .type = V_LIST, .list_value = nl };
+
+	for (int i = 0; i < num_runs; i++) {
+		double t = time_reduce(list, false, threads[i]);
+		printf("bench=reduce op=sum n=%d threads=%d ns_per_elem=%.2f\n",
+			m, threads[i], t / m);
+	}
+
+	pool_init(cpus);
+	arena_reset(&ctx.arena);
+}
+
+// sum of a list of integers and rationals, num_add_into() from left to
+// right against the buckets of num_sum_add()
+// real puts one real in front, then the left fold rounds at every step
+static void run_sum_mixed(char* param, bool real, int n) {
+	int dens[] = { 3, 6, 12, 24 };
+
+	NumberList nl = nl_new();
+	char buf[64];
+	for (int i = 0; i < n; i++) {
+		if (real && i == 0) {
+			snprintf(buf, sizeof(buf), "0.5");
+		} else if (i % 2 == 0) {
+			snprintf(buf, sizeof(buf), "%d", i);
+		} else {
+			snprintf(buf, sizeof(buf), "%d/%d", i, dens[i / 2 % 4]);
+		}
+		Number x;
+		num_from_str(buf, strlen(buf), &x);
+		nl_append(&nl, x);
+	}
+
+	double best_fold = 0;
+	double best_sum = 0;
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		double start = now_ns();
+		Number acc = num_small(0);
+		for (int i = 0; i < n; i++) {
+			num_add_into(&acc, &nl.nums[i]);
+		}
+		double t = now_ns() - start;
+		if (rep == 0 || t < best_fold) {
+			best_fold = t;
+		}
+		num_clear(acc);
+
+		start = now_ns();
+		NumberSum s;
+		num_sum_init(&s);
+		for (int i = 0; i < n; i++) {
+			num_sum_add(&s, &nl.nums[i]);
+		}
+		num_clear(num_sum_finish(&s));
+		t = now_ns() - start;
+		if (rep == 0 || t < best_sum) {
+			best_sum = t;
+		}
+	}
+
+	printf("bench=sum_mixed/fold %s n=%d ns_per_elem=%.2f\n",
+		param, n, best_fold / n);
+	printf("bench=sum_mixed/buckets %s n=%d ns_per_elem=%.2f\n",
+		param, n, best_sum / n);
+
+	arena_reset(&ctx.arena);
+}
+
+static void bench_sum_mixed() {
+	run_sum_mixed("mix=int_rational", false, 1000000);
+	run_sum_mixed("mix=int_rational_real", true, 1000000);
+}
+
+// #pi through the vm, computed on first use at each precision and
+// looked up after that
+static void bench_const() {
+	mpfr_prec_t saved = mpfr_get_default_prec();
+	Expr* e = parse_str("#pi");
+	Chunk c = compile(e);
+
+	char* precs[] = { "53", "100000" };
+	for (size_t i = 0; i < sizeof(precs) / sizeof(precs[0]); i++) {
+		rt_set_prec(precs[i]);
+
+		double best_cold = 0;
+		double best_hit = 0;
+		int runs = 1000;
+
+		for (int rep = 0; rep < BENCH_REPS; rep++) {
+			// mpfr's own cache goes away after every evaluation
+			rt_constant_cache_clear();
+			mpfr_free_cache();
+
+			double start = now_ns();
+			vm_run(&c);
+			double t = now_ns() - start;
+			if (rep == 0 || t < best_cold) {
+				best_cold = t;
+			}
+
+			start = now_ns();
+			for (int k = 0; k < runs; k++) {
+				vm_run(&c);
+			}
+			t = now_ns() - start;
+			if (rep == 0 || t < best_hit) {
+				best_hit = t;
+			}
+		}
+
+		printf("bench=const name=#pi prec=%s cold_us=%.1f cached_ns=%.1f\n",
+			precs[i], best_cold / 1e3, best_hit / runs);
+	}
+
+	mpfr_set_default_prec(saved);
+	rt_constant_cache_clear();
+	arena_reset(&ctx.arena);
+}
+
+// num_from_str() on one literal, gmp allocations are counted by the hooks
+static void run_literal(char* param, char* lit) {
+	int len = strlen(lit);
+	int runs = (len > 1000) ? 1000 : 1000000;
+	double best = 0;
+	size_t allocs = 0;
+
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		ctx.gmp_stats = (GmpAllocStats){0};
+		double start = now_ns();
+		for (int i = 0; i < runs; i++) {
+			Number n;
+			num_from_str(lit, len, &n);
+			num_clear(n);
+		}
+		double t = now_ns() - start;
+		if (rep == 0 || t < best) {
+			best = t;
+		}
+		allocs = ctx.gmp_stats.allocs;
+	}
+
+	printf("bench=literal %s len=%d ns_per_op=%.2f allocs_per_op=%.3f\n",
+		param, len, best / runs, (double)allocs / runs);
+}
+
+static void bench_literal() {
+	run_literal("kind=small", "12345");
+	run_literal("kind=18_digits", "-123456789012345678");
+	run_literal("kind=hex", "0x7fffffffffffffff");
+	run_literal("kind=big", "123456789012345678901234567890");
+	run_literal("kind=rational", "355/113");
+	run_literal("kind=real", "3.14159");
+
+	// gmp converts this one in subquadratic time
+	char* huge = malloc(100001);
+	memset(huge, '7', 100000);
+	huge[100000] = '\0';
+	run_literal("kind=huge", huge);
+	free(huge);
+}
+
+// renders a list of n numbers into ctx.out, the way a result is printed,
+// and writes it to /dev/null with one write()
+// lit is a printf format for the i-th number
+static void run_print(char* param, char* lit, int n) {
+	NumberList nl = nl_new();
+	char buf[64];
+	for (int i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), lit, i);
+		Number x;
+		num_from_str(buf, strlen(buf), &x);
+		nl_append(&nl, x);
+	}
+	Value v = { .type = V_LIST, .list_value = nl };
+
+	int null_fd = open("/dev/null", O_WRONLY);
+	double best = 0;
+	size_t bytes = 0;
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		double start = now_ns();
+		dstr_clear(ctx.out);
+		print_value(v);
+		bytes = ctx.out.len;
+		write(null_fd, ctx.out.data, ctx.out.len);
+		double t = now_ns() - start;
+		if (rep == 0 || t < best) {
+			best = t;
+		}
+	}
+	close(null_fd);
+	dstr_clear(ctx.out);
+
+	printf("bench=print %s n=%d ns_per_num=%.2f mb_per_s=%.1f\n",
+		param, n, best / n, bytes / (best / 1e3));
+	arena_reset(&ctx.arena);
+}
+
+static void bench_print() {
+	// small enough that ctx.out is written out only once at the end
+	run_print("kind=small", "%d", 10000);
+	run_print("kind=big", "%d00000000000000000000000000000", 1000);
+	run_print("kind=rational", "%d/7", 5000);
+	run_print("kind=real", "%d.25", 1000);
+}
+
+// microbenchmarks: one step of the pipeline or one number operation at a
+// time, over a range of sizes, all reported the same way
+// they run like an evaluation does, with gmp allocating from the arena
+
+typedef void MicroFn(void* arg);
+
+typedef struct {
+	// untimed, runs before every batch, after the arena was reset
+	MicroFn* setup;
+	// one operation
+	MicroFn* op;
+	void* arg;
+
+	// input bytes of one operation, 0 if bytes per second make no sense
+	size_t bytes;
+} Micro;
+
+// a batch runs at least this long
+#define MICRO_BATCH_NS 2e6
+
+// times batches of m.op and prints the best one per operation
+static void run_micro(char* name, char* param, Micro m) {
+	// the batch size is doubled until a batch takes long enough
+	long batch = 1;
+	double best = 0;
+	size_t allocs = 0;
+	size_t arena_bytes = 0;
+
+	ctx.gmp_use_arena = true;
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		while (true) {
+			arena_reset(&ctx.arena);
+			if (m.setup != NULL) {
+				m.setup(m.arg);
+			}
+			size_t arena_start = ctx.arena.total;
+			ctx.gmp_stats = (GmpAllocStats){0};
+
+			double start = now_ns();
+			for (long i = 0; i < batch; i++) {
+				m.op(m.arg);
+			}
+			double t = now_ns() - start;
+
+			if (t < MICRO_BATCH_NS && rep == 0) {
+				batch *= 2;
+				continue;
+			}
+
+			if (rep == 0 || t / batch < best) {
+				best = t / batch;
+				allocs = ctx.gmp_stats.allocs + ctx.gmp_stats.reallocs;
+				arena_bytes = ctx.arena.total - arena_start;
+			}
+			break;
+		}
+	}
+	arena_reset(&ctx.arena);
+	ctx.gmp_use_arena = false;
+
+	printf("bench=micro/%s %s ns_per_op=%.2f allocs_per_op=%.3f "
+		"arena_bytes_per_op=%.1f ops_per_s=%.0f",
+		name, param, best, (double)allocs / batch,
+		(double)arena_bytes / batch, 1e9 / best);
+	if (m.bytes > 0) {
+		printf(" mb_per_s=%.2f", m.bytes / best * 1e3);
+	}
+	putchar('\n');
+}
+
+// the front end steps on one program, each one gets the output of the step
+// before it from its setup
+typedef struct {
+	char* prog;
+	TokenList tl;
+	ASTNode* ast;
+	Expr* expr;
+	Chunk chunk;
+} FrontEnd;
+
+static void micro_tokenize(void* arg) {
+	FrontEnd* fe = arg;
+	tokenize(fe->prog);
+}
+
+static void setup_make_ast(void* arg) {
+	FrontEnd* fe = arg;
+	fe->tl = tokenize(fe->prog);
+}
+
+static void micro_make_ast(void* arg) {
+	FrontEnd* fe = arg;
+	make_ast(fe->tl);
+}
+
+static void setup_parse(void* arg) {
+	FrontEnd* fe = arg;
+	fe->ast = make_ast(tokenize(fe->prog));
+}
+
+static void micro_parse(void* arg) {
+	FrontEnd* fe = arg;
+	parse(fe->ast);
+}
+
+static void micro_parse_str(void* arg) {
+	FrontEnd* fe = arg;
+	parse_str(fe->prog);
+}
+
+static void setup_eval(void* arg) {
+	FrontEnd* fe = arg;
+	fe->expr = parse_str(fe->prog);
+	fe->chunk = compile(fe->expr);
+}
+
+static void micro_compile(void* arg) {
+	FrontEnd* fe = arg;
+	compile(fe->expr);
+}
+
+static void micro_eval_tree(void* arg) {
+	FrontEnd* fe = arg;
+	eval(fe->expr);
+}
+
+static void micro_eval_vm(void* arg) {
+	FrontEnd* fe = arg;
+	vm_run(&fe->chunk);
+}
+
+// "(sum (list 0 1 2 ... n-1))"
+static char* gen_sum_list(int n) {
+	char* s = malloc(n * 12 + 16);
+	char* p = s;
+	p += sprintf(p, "(sum (list");
+	for (int i = 0; i < n; i++) {
+		p += sprintf(p, " %d", i);
+	}
+	sprintf(p, "))");
+	return s;
+}
+
+static void bench_micro_front_end() {
+	char* progs[] = {
+		"(+ 1 2)",
+		"(+ (+ 2 3) (+ (sum (list 1 2 3 #pi)) (max (range 1 100))))",
+		gen_balanced(6),
+		gen_deep(1000),
+		gen_sum_list(10000),
+	};
+	char* params[] = {
+		"prog=call", "prog=mixed", "prog=balanced_6", "prog=deep_1000",
+		"prog=list_10000"
+	};
+
+	for (size_t i = 0; i < sizeof(progs) / sizeof(progs[0]); i++) {
+		FrontEnd fe = { .prog = progs[i] };
+		size_t len = strlen(progs[i]);
+
+		run_micro("tokenize", params[i],
+			(Micro){ NULL, micro_tokenize, &fe, len });
+		run_micro("make_ast", params[i],
+			(Micro){ setup_make_ast, micro_make_ast, &fe, len });
+		run_micro("parse", params[i],
+			(Micro){ setup_parse, micro_parse, &fe, len });
+		run_micro("parse_str", params[i],
+			(Micro){ NULL, micro_parse_str, &fe, len });
+		run_micro("compile", params[i],
+			(Micro){ setup_eval, micro_compile, &fe, 0 });
+		run_micro("eval/tree", params[i],
+			(Micro){ setup_eval, micro_eval_tree, &fe, 0 });
+		run_micro("eval/vm", params[i],
+			(Micro){ setup_eval, micro_eval_vm, &fe, 0 });
+	}
+
+	for (size_t i = 2; i < sizeof(progs) / sizeof(progs[0]); i++) {
+		free(progs[i]);
+	}
+}
+
+// operand sizes of the number benchmarks, in decimal digits, reals get the
+// same number of bits a number of that many digits has
+static int MICRO_DIGITS[] = { 5, 30, 300, 30000 };
+
+// a literal of a number type with about digits digits:
+// 'Z' integer, 'Q' rational (half the digits above the line), 'R' real
+static char* gen_literal(char type, int digits) {
+	char* s = malloc(digits + 8);
+	char* p = s;
+	int n = (type == 'Q') ? max(1, digits / 2) : digits;
+	for (int i = 0; i < n; i++) {
+		*p++ = '1' + (i * 7) % 9;
+	}
+	if (type == 'Q') {
+		*p++ = '/';
+		for (int i = 0; i < max(1, digits - n); i++) {
+			*p++ = '1' + (i * 5) % 9;
+		}
+	} else if (type == 'R') {
+		memcpy(p, ".5", 2);
+		p += 2;
+	}
+	*p = '\0';
+	return s;
+}
+
+#define digits_to_prec(digits) \
+	max(53, (mpfr_prec_t)((digits) * 3.33))
+
+typedef struct {
+	char* lit;
+	int len;
+} Literal;
+
+static void micro_num_from_str(void* arg) {
+	Literal* l = arg;
+	Number n;
+	num_from_str(l->lit, l->len, &n);
+	num_clear(n);
+}
+
+static void bench_micro_literal() {
+	mpfr_prec_t saved = mpfr_get_default_prec();
+	char* types = "ZQR";
+
+	for (int t = 0; t < 3; t++) {
+		for (size_t d = 0; d < sizeof(MICRO_DIGITS) / sizeof(int); d++) {
+			int digits = MICRO_DIGITS[d];
+			mpfr_set_default_prec(digits_to_prec(digits));
+
+			char* lit = gen_literal(types[t], digits);
+			Literal l = { lit, strlen(lit) };
+			char param[64];
+			sprintf(param, "type=%c digits=%d", types[t], digits);
+			run_micro("num_from_str", param,
+				(Micro){ NULL, micro_num_from_str, &l, l.len });
+			free(lit);
+		}
+	}
+
+	mpfr_set_default_prec(saved);
+}
+
+typedef struct {
+	void (*add)(Number n1, Number n2, Number* out, uint8_t out_base);
+	Number n1;
+	Number n2;
+} NumAdd;
+
+static void micro_num_add(void* arg) {
+	NumAdd* a = arg;
+	Number out;
+	a->add(a->n1, a->n2, &out, 10);
+	num_clear(out);
+}
+
+static void bench_micro_num_add() {
+	struct {
+		char* types;
+		void (*add)(Number n1, Number n2, Number* out, uint8_t out_base);
+	} combos[] = {
+		{ "ZZ", num_add_ZZ_Z }, { "ZQ", num_add_ZQ_Q }, { "ZR", num_add_ZR_R },
+		{ "QZ", num_add_QZ_Q }, { "QQ", num_add_QQ_Q }, { "QR", num_add_QR_R },
+		{ "RZ", num_add_RZ_R }, { "RQ", num_add_RQ_R }, { "RR", num_add_RR_R },
+	};
+	mpfr_prec_t saved = mpfr_get_default_prec();
+
+	for (size_t c = 0; c < sizeof(combos) / sizeof(combos[0]); c++) {
+		for (size_t d = 0; d < sizeof(MICRO_DIGITS) / sizeof(int); d++) {
+			int digits = MICRO_DIGITS[d];
+			mpfr_set_default_prec(digits_to_prec(digits));
+
+			// made outside of the arena, they outlive the batches
+			NumAdd a = { .add = combos[c].add };
+			char* lit1 = gen_literal(combos[c].types[0], digits);
+			char* lit2 = gen_literal(combos[c].types[1], digits);
+			num_from_str(lit1, strlen(lit1), &a.n1);
+			num_from_str(lit2, strlen(lit2), &a.n2);
+
+			char param[64];
+			sprintf(param, "types=%s digits=%d small=%d", combos[c].types,
+				digits, a.n1.type == NUM_INTEGER && a.n1.is_small
+				&& a.n2.type == NUM_INTEGER && a.n2.is_small);
+			run_micro("num_add", param,
+				(Micro){ NULL, micro_num_add, &a, 0 });
+
+			num_clear(a.n1);
+			num_clear(a.n2);
+			free(lit1);
+			free(lit2);
+		}
+	}
+
+	mpfr_set_default_prec(saved);
+}
+
+static void micro_num_write(void* arg) {
+	dstr_clear(ctx.out);
+	num_write(&ctx.out, *(Number*)arg);
+}
+
+static void bench_micro_print() {
+	mpfr_prec_t saved = mpfr_get_default_prec();
+	char* types = "ZQR";
+
+	for (int t = 0; t < 3; t++) {
+		for (size_t d = 0; d < sizeof(MICRO_DIGITS) / sizeof(int); d++) {
+			int digits = MICRO_DIGITS[d];
+			mpfr_set_default_prec(digits_to_prec(digits));
+
+			char* lit = gen_literal(types[t], digits);
+			Number n;
+			num_from_str(lit, strlen(lit), &n);
+
+			// bytes written, not read
+			dstr_clear(ctx.out);
+			num_write(&ctx.out, n);
+			size_t bytes = ctx.out.len;
+
+			char param[64];
+			sprintf(param, "type=%c digits=%d", types[t], digits);
+			run_micro("print", param,
+				(Micro){ NULL, micro_num_write, &n, bytes });
+
+			num_clear(n);
+			free(lit);
+		}
+	}
+
+	dstr_clear(ctx.out);
+	mpfr_set_default_prec(saved);
+}
+
+static Bench BENCHMARKS[] = {
+	{ "make_ast/deep", bench_make_ast_deep },
+	{ "make_ast/wide", bench_make_ast_wide },
+	{ "front_end/deep", bench_front_end_deep },
+	{ "front_end/wide", bench_front_end_wide },
+	{ "eval/deep", bench_eval_deep },
+	{ "eval/balanced", bench_eval_balanced },
+	{ "literal", bench_literal },
+	{ "num_add", bench_num_add },
+	{ "fold", bench_fold },
+	{ "fib", bench_fib },
+	{ "const", bench_const },
+	{ "list", bench_list },
+	{ "simd", bench_simd },
+	{ "reduce", bench_reduce },
+	{ "print", bench_print },
+	{ "sum_mixed", bench_sum_mixed },
+	{ "micro/front_end", bench_micro_front_end },
+	{ "micro/num_from_str", bench_micro_literal },
+	{ "micro/num_add", bench_micro_num_add },
+	{ "micro/print", bench_micro_print },
+};
+
+int main(int argc, char** argv) {
+	char* filter = (argc > 1) ? argv[1] : "";
+
+	mpfr_set_default_rounding_mode(MPFR_RNDN);
+	rt_init();
+
+	// a benchmark should never hit an error
+	if (setjmp(ctx.eval_env) != 0) {
+		out_flush();
+		fputs("bench: evaluation failed\n", stderr);
+		return 1;
+	}
+
+	for (size_t i = 0; i < sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]); i++) {
+		if (strncmp(BENCHMARKS[i].name, filter, strlen(filter)) == 0) {
+			BENCHMARKS[i].fn();
+		}
+	}
+
+	arena_free(&ctx.arena);
+	return 0;
+}
@@ -0,0 +1,85 @@
+#!/bin/sh
+# writes the end to end workloads for bench/e2e.c, one file per kind of
+# input, the same files every time
+# usage: bench/corpus.sh [output directory]
+
+OUT=${1:-build/corpus}
+mkdir -p "$OUT"
+
+# small integer arithmetic, nothing leaves the int64_t fast path
+awk 'BEGIN {
+	for (i = 0; i < 20000; i++) {
+		a = (i * 7919) % 100000
+		b = (i * 104729) % 1000
+		if (i % 4 == 0) printf "(+ %d %d)\n", a, b
+		else if (i % 4 == 1) printf "(+ (+ %d %d) (+ %d 1))\n", a, b, i
+		else if (i % 4 == 2) printf "(sum (list %d %d %d %d))\n", a, b, i, -a
+		else printf "(max (list %d %d %d))\n", a, b, i
+	}
+}' > "$OUT/small_int.pnc"
+
+# rationals that do not cancel, denominators grow along the sums
+awk 'BEGIN {
+	for (i = 0; i < 10000; i++) {
+		a = i % 97 + 1
+		b = i % 89 + 2
+		if (i % 3 == 0) printf "(+ %d/%d %d/%d)\n", a, b, b, a + 1
+		else if (i % 3 == 1) {
+			printf "(sum (list"
+			for (k = 1; k <= 8; k++) printf " %d/%d", a + k, b + 2 * k
+			printf "))\n"
+		}
+		else printf "(+ (+ 1/%d 2/%d) (min (list %d/7 %d/11)))\n", a, b, a, b
+	}
+}' > "$OUT/rational.pnc"
+
+# reals at 2000 bits, constants included
+awk 'BEGIN {
+	print ":prec 2000"
+	for (i = 0; i < 5000; i++) {
+		if (i % 3 == 0) printf "(+ %d.%d #pi)\n", i, i % 1000
+		else if (i % 3 == 1) printf "(sum (list %d.5 #e 1/3 %d))\n", i, i
+		else printf "(+ (+ 0.%d 1.25) (+ #pi #e))\n", i
+	}
+}' > "$OUT/real_prec.pnc"
+
+# long lists and ranges, the packed and simd paths
+awk 'BEGIN {
+	for (i = 0; i < 1000; i++) {
+		n = 1000 + (i % 10) * 500
+		if (i % 4 == 0) {
+			printf "(sum (list"
+			for (k = 0; k < 200; k++) printf " %d", (k * i) % 1000
+			printf "))\n"
+		}
+		else if (i % 4 == 1) printf "(sum (range 1 %d))\n", n * 100
+		else if (i % 4 == 2) printf "(count (range 1 %d) %d)\n", n, i
+		else printf "(prod (range 1 %d))\n", 50 + i % 200
+	}
+}' > "$OUT/lists.pnc"
+
+# deep nesting, the parser and the vm without recursion
+awk 'BEGIN {
+	for (i = 0; i < 200; i++) {
+		d = 100 + (i % 20) * 100
+		for (k = 0; k < d; k++) printf "(+ 1 "
+		printf "1"
+		for (k = 0; k < d; k++) printf ")"
+		printf "\n"
+	}
+}' > "$OUT/deep.pnc"
+
+# huge literals, decimal and hex, integers and rationals
+awk 'function digits(n, seed,    s, k) {
+	s = ""
+	for (k = 0; k < n; k++) s = s ((k * seed + 7) % 10)
+	return "9" s
+}
+BEGIN {
+	for (i = 0; i < 100; i++) {
+		n = 1000 + (i % 10) * 2000
+		if (i % 3 == 0) printf "(+ %s %s)\n", digits(n, 3), digits(n, 7)
+		else if (i % 3 == 1) printf "(+ %s/%s 1)\n", digits(n, 11), digits(n / 2, 13)
+		else printf "(+ 0x%s 1)\n", digits(n, 17)
+	}
+}' > "$OUT/huge_literals.pnc"
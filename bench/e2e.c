@@ -0,0 +1,306 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/stats.h"
+
+// end to end benchmark: runs the real pnc binary over workload files, see
+// bench/corpus.sh, and reports throughput, latency per line and memory
+// usage: build/e2e [--pnc <path>] [--runs <n>] [--save <file>]
+//	[--compare <file>] [--threshold <percent>] <corpus files>
+// prints one line per file as key=value pairs, the same format --save
+// writes and --compare reads
+
+// best of this many runs is reported
+#define E2E_RUNS 3
+
+// more than this many percent worse than the baseline is a regression
+#define E2E_THRESHOLD 10.0
+
+typedef struct {
+	char name[64];
+	long lines;
+	double lines_per_s;
+	double p50_us;
+	double p99_us;
+	long max_rss_kb;
+} Result;
+
+// the compared metrics, higher_is_better says which way is worse
+typedef struct {
+	char* key;
+	size_t offset;
+	bool higher_is_better;
+} Metric;
+
+#define METRIC(field, higher) \
+	{ #field, offsetof(Result, field), higher }
+
+static Metric METRICS[] = {
+	METRIC(lines_per_s, true),
+	METRIC(p50_us, false),
+	METRIC(p99_us, false),
+};
+
+#define metric_value(r, m) \
+	(*(double*)((char*)(r) + (m)->offset))
+
+static char* pnc_path = "build/pnc";
+
+static void die(char* what, char* arg) {
+	fprintf(stderr, "e2e: %s %s: %s\n", what, arg, strerror(errno));
+	exit(2);
+}
+
+static long count_lines(char* path) {
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		die("could not open", path);
+	}
+	long lines = 0;
+	int c;
+	while ((c = getc(f)) != EOF) {
+		lines += (c == '\n');
+	}
+	fclose(f);
+	return lines;
+}
+
+// runs pnc with the file as stdin and the output thrown away, with
+// --timing the per line times are read from its stderr into hist
+// returns the wall time in ns, the peak rss goes to max_rss_kb
+static uint64_t run_pnc(char* path, LatencyHist* hist, long* max_rss_kb) {
+	int in = open(path, O_RDONLY);
+	if (in < 0) {
+		die("could not open", path);
+	}
+	int null = open("/dev/null", O_WRONLY);
+	int err[2];
+	if (hist != NULL && pipe(err) != 0) {
+		die("could not create a pipe for", path);
+	}
+
+	uint64_t start = clock_ns();
+	pid_t pid = fork();
+	if (pid < 0) {
+		die("could not fork for", path);
+	}
+	if (pid == 0) {
+		dup2(in, STDIN_FILENO);
+		dup2(null, STDOUT_FILENO);
+		if (hist != NULL) {
+			dup2(err[1], STDERR_FILENO);
+			close(err[0]);
+			close(err[1]);
+		}
+		char* argv[] = { pnc_path, hist ? "--timing" : NULL, NULL };
+		execv(pnc_path, argv);
+		_exit(127);
+	}
+	close(in);
+	close(null);
+
+	if (hist != NULL) {
+		close(err[1]);
+		FILE* f = fdopen(err[0], "r");
+		char* line = NULL;
+		size_t cap = 0;
+		while (getline(&line, &cap, f) != -1) {
+			char* total = strstr(line, "total_us=");
+			if (strncmp(line, "timing:", 7) == 0 && total != NULL) {
+				hist_add(hist, strtod(total + 9, NULL) * 1e3);
+			}
+		}
+		free(line);
+		fclose(f);
+	}
+
+	int status;
+	struct rusage ru;
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		die("could not wait for", pnc_path);
+	}
+	uint64_t ns = clock_ns() - start;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "e2e: %s failed on %s\n", pnc_path, path);
+		exit(2);
+	}
+	*max_rss_kb = ru.ru_maxrss;
+	return ns;
+}
+
+// throughput and memory from runs without --timing, so the clock and
+// the timing lines do not count, latencies from one run with it
+static Result bench_file(char* path, int runs) {
+	Result r = {0};
+	char* base = strrchr(path, '/');
+	base = base ? base + 1 : path;
+	snprintf(r.name, sizeof(r.name), "%.*s",
+		(int)strcspn(base, "."), base);
+	r.lines = count_lines(path);
+
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < runs; i++) {
+		long rss;
+		uint64_t ns = run_pnc(path, NULL, &rss);
+		best = (ns < best) ? ns : best;
+		r.max_rss_kb = (rss > r.max_rss_kb) ? rss : r.max_rss_kb;
+	}
+	r.lines_per_s = r.lines / (best / 1e9);
+
+	LatencyHist* hist = calloc(1, sizeof(LatencyHist));
+	long rss;
+	run_pnc(path, hist, &rss);
+	r.p50_us = hist_percentile(hist, 50) / 1e3;
+	r.p99_us = hist_percentile(hist, 99) / 1e3;
+	free(hist);
+
+	return r;
+}
+
+static void write_result(FILE* f, Result* r) {
+	fprintf(f, "e2e=%s lines=%ld lines_per_s=%.0f p50_us=%.1f p99_us=%.1f "
+		"max_rss_kb=%ld\n", r->name, r->lines, r->lines_per_s, r->p50_us,
+		r->p99_us, r->max_rss_kb);
+}
+
+static bool read_result(char* line, Result* r) {
+	*r = (Result){0};
+	return sscanf(line, "e2e=%63s lines=%ld lines_per_s=%lf p50_us=%lf "
+		"p99_us=%lf max_rss_kb=%ld", r->name, &r->lines, &r->lines_per_s,
+		&r->p50_us, &r->p99_us, &r->max_rss_kb) == 6;
+}
+
+// how many percent worse now is than then, negative if it is better
+static double worse_pct(double then, double now, bool higher_is_better) {
+	if (then == 0) {
+		return 0;
+	}
+	double pct = (now - then) / then * 100;
+	return higher_is_better ? -pct : pct;
+}
+
+// prints a line for every metric that got worse by more than threshold
+// percent, returns how many did
+static int compare(Result* results, int num_results, char* path,
+double threshold) {
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		die("could not open", path);
+	}
+
+	int regressions = 0;
+	char* line = NULL;
+	size_t cap = 0;
+	Result then;
+	while (getline(&line, &cap, f) != -1) {
+		if (!read_result(line, &then)) {
+			continue;
+		}
+		Result* now = NULL;
+		for (int i = 0; i < num_results; i++) {
+			if (strcmp(results[i].name, then.name) == 0) {
+				now = &results[i];
+			}
+		}
+		if (now == NULL) {
+			continue;
+		}
+
+		int num_metrics = sizeof(METRICS) / sizeof(METRICS[0]);
+		for (int m = 0; m < num_metrics; m++) {
+			Metric* metric = &METRICS[m];
+			double a = metric_value(&then, metric);
+			double b = metric_value(now, metric);
+			double pct = worse_pct(a, b, metric->higher_is_better);
+			if (pct > threshold) {
+				printf("regression: e2e=%s %s baseline=%.1f now=%.1f "
+					"worse_pct=%.1f\n", now->name, metric->key, a, b, pct);
+				regressions++;
+			}
+		}
+		double pct = worse_pct(then.max_rss_kb, now->max_rss_kb, false);
+		if (pct > threshold) {
+			printf("regression: e2e=%s max_rss_kb baseline=%ld now=%ld "
+				"worse_pct=%.1f\n", now->name, then.max_rss_kb,
+				now->max_rss_kb, pct);
+			regressions++;
+		}
+	}
+	free(line);
+	fclose(f);
+	return regressions;
+}
+
+static void usage() {
+	fputs("usage: e2e [--pnc <path>] [--runs <n>] [--save <file>]\n"
+		"\t[--compare <file>] [--threshold <percent>] <corpus files>\n",
+		stderr);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	int runs = E2E_RUNS;
+	char* save_path = NULL;
+	char* compare_path = NULL;
+	double threshold = E2E_THRESHOLD;
+
+	int i = 1;
+	for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+		if (i + 1 >= argc) {
+			usage();
+		}
+		if (strcmp(argv[i], "--pnc") == 0) {
+			pnc_path = argv[++i];
+		} else if (strcmp(argv[i], "--runs") == 0) {
+			runs = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--save") == 0) {
+			save_path = argv[++i];
+		} else if (strcmp(argv[i], "--compare") == 0) {
+			compare_path = argv[++i];
+		} else if (strcmp(argv[i], "--threshold") == 0) {
+			threshold = atof(argv[++i]);
+		} else {
+			usage();
+		}
+	}
+	if (i == argc || runs < 1) {
+		usage();
+	}
+
+	int num_results = argc - i;
+	Result* results = malloc(sizeof(Result) * num_results);
+	for (int k = 0; k < num_results; k++) {
+		results[k] = bench_file(argv[i + k], runs);
+		write_result(stdout, &results[k]);
+		fflush(stdout);
+	}
+
+	if (save_path != NULL) {
+		FILE* f = fopen(save_path, "w");
+		if (f == NULL) {
+			die("could not open", save_path);
+		}
+		for (int k = 0; k < num_results; k++) {
+			write_result(f, &results[k]);
+		}
+		fclose(f);
+	}
+
+	int regressions = 0;
+	if (compare_path != NULL) {
+		regressions = compare(results, num_results, compare_path, threshold);
+		printf("regressions=%d threshold_pct=%.1f\n", regressions, threshold);
+	}
+
+	free(results);
+	return regressions > 0;
+}
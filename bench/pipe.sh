@@ -0,0 +1,26 @@
+#!/bin/sh
+# pipe a generated workload through pnc and report lines/sec
+# usage: bench/pipe.sh [path/to/pnc] [number of lines]
+
+PNC=${1:-./build/pnc}
+LINES=${2:-100000}
+INPUT=$(mktemp)
+trap 'rm -f "$INPUT"' EXIT
+
+# mix of integer, rational and nested expressions, one per line
+awk -v n="$LINES" 'BEGIN {
+	for (i = 0; i < n; i++) {
+		if (i % 3 == 0) printf "(+ %d %d)\n", i, i * 7
+		else if (i % 3 == 1) printf "+ %d/3 %d\n", i, i
+		else printf "(+ (+ %d 1) (+ 2/5 %d))\n", i, i
+	}
+}' > "$INPUT"
+
+START=$(date +%s.%N)
+cat "$INPUT" | "$PNC" > /dev/null
+END=$(date +%s.%N)
+
+awk -v n="$LINES" -v s="$START" -v e="$END" 'BEGIN {
+	t = e - s
+	printf "%d lines in %.3fs: %.0f lines/sec\n", n, t, n / t
+}'
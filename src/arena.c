@@ -0,0 +1,181 @@
+#include <stdio.h>
+
+#include "arena.h"
+
+#define align_up(n) \
+	(((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+static ArenaChunk* arena_chunk_new(size_t size) {
+	ArenaChunk* c = malloc(sizeof(ArenaChunk) + size);
+	if (c == NULL) {
+		fputs("fatal: out of memory\n", stderr);
+		abort();
+	}
+	c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	return c;
+}
+
+// counts n more bytes as handed out
+#define arena_count(a, n) \
+	do { \
+		(a)->total += (n); \
+		(a)->used += (n); \
+		if ((a)->used > (a)->peak) { \
+			(a)->peak = (a)->used; \
+		} \
+	} while(0)
+
+void* arena_alloc(Arena* a, size_t size) {
+	size = align_up(size);
+
+	if (a->current == NULL || a->current->size - a->current->used < size) {
+		// chunks double in size so a big evaluation only needs a few
+		size_t chunk_size = (a->current == NULL)
+			? ARENA_CHUNK_SIZE
+			: 2 * a->current->size;
+		if (chunk_size < size) {
+			chunk_size = size;
+		}
+
+		// close to the limit the chunk gets whatever is left
+		if (a->limit != 0 && a->chunk_bytes + chunk_size > a->limit) {
+			size_t left = (a->chunk_bytes < a->limit)
+				? a->limit - a->chunk_bytes
+				: 0;
+			if (left < size) {
+				a->over_limit(a, size);
+			}
+			chunk_size = left;
+		}
+
+		ArenaChunk* c = arena_chunk_new(chunk_size);
+		c->next = a->current;
+		a->current = c;
+		a->chunk_bytes += chunk_size;
+	}
+
+	char* p = a->current->data + a->current->used;
+	a->current->used += size;
+	a->last = p;
+	arena_count(a, size);
+	return p;
+}
+
+void* arena_calloc(Arena* a, size_t n, size_t size) {
+	void* p = arena_alloc(a, n * size);
+	memset(p, 0, n * size);
+	return p;
+}
+
+void* arena_realloc(Arena* a, void* ptr, size_t old_size, size_t new_size) {
+	if (ptr == NULL) {
+		return arena_alloc(a, new_size);
+	}
+
+	// the last allocation can grow in place if the chunk has room
+	if (ptr == a->last) {
+		size_t start = a->last - a->current->data;
+		size_t end = start + align_up(new_size);
+		if (end <= a->current->size) {
+			if (end >= a->current->used) {
+				arena_count(a, end - a->current->used);
+			} else {
+				a->used -= a->current->used - end;
+			}
+			a->current->used = end;
+			return ptr;
+		}
+	}
+
+	if (new_size <= old_size) {
+		return ptr;
+	}
+
+	void* p = arena_alloc(a, new_size);
+	memcpy(p, ptr, old_size);
+	return p;
+}
+
+bool arena_fits(Arena* a, size_t size) {
+	size = align_up(size);
+	if (a->limit == 0) {
+		return true;
+	}
+	if (a->current != NULL && a->current->size - a->current->used >= size) {
+		return true;
+	}
+	return a->chunk_bytes + size <= a->limit;
+}
+
+void arena_pop(Arena* a, void* ptr) {
+	if (ptr != NULL && ptr == a->last) {
+		size_t start = a->last - a->current->data;
+		a->used -= a->current->used - start;
+		a->current->used = start;
+		a->last = NULL;
+	}
+}
+
+bool arena_owns(Arena* a, void* ptr) {
+	for (ArenaChunk* c = a->current; c != NULL; c = c->next) {
+		if ((char*)ptr >= c->data && (char*)ptr < c->data + c->used) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void arena_reset(Arena* a) {
+	if (a->current == NULL) {
+		return;
+	}
+
+	a->last = NULL;
+	a->total = 0;
+	a->used = 0;
+	a->peak = 0;
+
+	// common case, everything fit in one chunk
+	if (a->current->next == NULL) {
+		a->current->used = 0;
+		return;
+	}
+
+	// replace the chunks with a single one big enough for all of them,
+	// so the next evaluation of the same size needs no new chunks
+	size_t total = 0;
+	ArenaChunk* c = a->current;
+	while (c != NULL) {
+		ArenaChunk* next = c->next;
+		total += c->size;
+		free(c);
+		c = next;
+	}
+
+	if (total > ARENA_KEEP_MAX) {
+		total = ARENA_KEEP_MAX;
+	}
+	if (a->limit != 0 && total > a->limit) {
+		total = a->limit;
+	}
+	a->current = arena_chunk_new(total);
+	a->chunk_bytes = total;
+}
+
+void arena_free(Arena* a) {
+	ArenaChunk* c = a->current;
+	while (c != NULL) {
+		ArenaChunk* next = c->next;
+		free(c);
+		c = next;
+	}
+
+	// the limit is a setting, it survives
+	size_t limit = a->limit;
+	void (*over_limit)(Arena* a, size_t size) = a->over_limit;
+	*a = arena_new();
+	a->limit = limit;
+	a->over_limit = over_limit;
+}
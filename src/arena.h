@@ -0,0 +1,88 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// bump allocator
+// everything allocated from an arena is freed at once by arena_reset(),
+// there is no way to free a single allocation
+
+// size of the first chunk, each chunk after it is twice as big
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+// a reset keeps at most this much memory around for the next evaluation
+#define ARENA_KEEP_MAX (64 * 1024 * 1024)
+
+// every allocation is aligned like malloc() would align it
+#define ARENA_ALIGN (_Alignof(max_align_t))
+
+typedef struct ArenaChunk {
+	// the chunk that was filled before this one
+	struct ArenaChunk* next;
+	size_t size; // usable bytes in data
+	size_t used;
+	_Alignas(max_align_t) char data[];
+} ArenaChunk;
+
+typedef struct Arena {
+	// newest chunk, the others are reachable through ->next
+	ArenaChunk* current;
+
+	// start of the most recent allocation, lets arena_realloc() grow it
+	// in place
+	char* last;
+
+	// what the chunks take from the system together
+	size_t chunk_bytes;
+
+	// since the last reset: bytes handed out, the part of them that was
+	// not given back by arena_pop() or a shrinking arena_realloc(), and
+	// the most that part ever was
+	size_t total;
+	size_t used;
+	size_t peak;
+
+	// if not 0, the chunks may not take more than this many bytes
+	// an allocation that does not fit calls over_limit(), which must not
+	// return
+	size_t limit;
+	void (*over_limit)(struct Arena* a, size_t size);
+} Arena;
+
+// a zeroed Arena is ready to use
+#define arena_new() \
+	((Arena){0})
+
+// never returns NULL, aborts if the system is out of memory
+void* arena_alloc(Arena* a, size_t size);
+
+// same as arena_alloc() but the memory is zeroed
+void* arena_calloc(Arena* a, size_t n, size_t size);
+
+// grows or shrinks ptr (which must come from a), the old contents are kept
+// ptr can be NULL, then this is the same as arena_alloc()
+void* arena_realloc(Arena* a, void* ptr, size_t old_size, size_t new_size);
+
+// false if allocating size bytes would run into the limit
+bool arena_fits(Arena* a, size_t size);
+
+// gives the memory of ptr back if it is the most recent allocation,
+// otherwise does nothing (it is freed by the next reset like the rest)
+void arena_pop(Arena* a, void* ptr);
+
+// true if ptr was handed out by a since the last reset
+bool arena_owns(Arena* a, void* ptr);
+
+// frees every allocation at once
+// the memory is kept (merged into one chunk, at most ARENA_KEEP_MAX and
+// the limit) for reuse by the next user
+void arena_reset(Arena* a);
+
+// gives all the memory back to the system
+void arena_free(Arena* a);
+
+#endif // ARENA_H
@@ -1,32 +1,88 @@
 #ifndef DSTR_H
 #define DSTR_H
 
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 // dynamic string type
+// data always ends in '\0' once something was appended, cap only grows,
+// so a dstr that is cleared and refilled stops allocating
 
 typedef struct {
     char* data;
     int len;
+    int cap;
 } dstr;
 
 #define dstr_new() \
     ((dstr){0})
 
+#define dstr_clear(ds) \
+    ((ds).len = 0)
+
+#define dstr_free(ds) \
+    do { \
+        free((ds).data); \
+        (ds) = dstr_new(); \
+    } while(0)
+
+// makes room for n more chars and the '\0'
+#define dstr_reserve(ds, n) \
+    do { \
+        int needed = (ds).len + (n) + 1; \
+        if (needed > (ds).cap) { \
+            (ds).cap = ((ds).cap * 2 > needed) ? (ds).cap * 2 : needed; \
+            (ds).data = realloc((ds).data, (ds).cap); \
+            if ((ds).data == NULL) { \
+                fputs("fatal: out of memory\n", stderr); \
+                abort(); \
+            } \
+        } \
+    } while(0)
+
 // pass by value
+#define dstr_append_len(ds, str, n) \
+    do { \
+        int n2 = (n); \
+        dstr_reserve(ds, n2); \
+        memcpy((ds).data + (ds).len, (str), n2); \
+        (ds).len += n2; \
+        (ds).data[(ds).len] = '\0'; \
+    } while(0)
+
 #define dstr_append(ds, cstr) \
     do { \
-        int new_len = (ds).len + strlen(cstr); \
-        (ds).data = realloc((ds).data, (new_len + 1) * sizeof(char)); \
-        (ds).len = new_len; \
-        strcat((ds).data, cstr); \
+        char* s2 = (cstr); \
+        dstr_append_len(ds, s2, strlen(s2)); \
     } while(0)
 
 #define dstr_append_char(ds, c) \
     do { \
-        char c2[2] = {c, '\0'}; \
-        dstr_append(ds, c2); \
+        dstr_reserve(ds, 1); \
+        (ds).data[(ds).len++] = (c); \
+        (ds).data[(ds).len] = '\0'; \
     } while(0)
 
+// appends like printf
+__attribute__((format(printf, 2, 3)))
+static inline void dstr_printf(dstr* ds, const char* fmt, ...) {
+    va_list args;
+
+    // formatted once if it fits in what is left, twice otherwise
+    dstr_reserve(*ds, 64);
+    va_start(args, fmt);
+    int n = vsnprintf(ds->data + ds->len, ds->cap - ds->len, fmt, args);
+    va_end(args);
+
+    if (n >= ds->cap - ds->len) {
+        dstr_reserve(*ds, n);
+        va_start(args, fmt);
+        vsnprintf(ds->data + ds->len, n + 1, fmt, args);
+        va_end(args);
+    }
+    ds->len += n;
+}
+
 #endif // DSTR_H
@@ -1,12 +1,5 @@
 #include "pnc.h"
 
-// global vars
-REPLContext ctx = {0};
-
-RT_FnList RT_BUILTIN_FUNCTIONS = {0};
-RT_VarList RT_CONSTANT_VARS = {0};
-ErrorString CPRV_ERROR_NAMES[] = {0};
-
 int main(int argc, char** argv) {
 
 	// round floats to nearest number
@@ -18,26 +11,58 @@ int main(int argc, char** argv) {
 	// validate args
 
 	bool args_valid = true;
-	if (argc != 1
-	|| (argc == 3 && strcmp(argv[1], "-s") != 0
-		&& strcmp(argv[1], "--string") != 0))
-	{
-		args_valid = false;
+	char* prog = NULL;
+	for (int i = 1; i < argc && args_valid; i++) {
+		bool has_value = i + 1 < argc;
+
+		if ((strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--string") == 0)
+		&& has_value && prog == NULL) {
+			prog = argv[++i];
+		} else if (strcmp(argv[i], "--prec") == 0 && has_value) {
+			args_valid = rt_set_prec(argv[++i]);
+		} else if (strcmp(argv[i], "--mem-limit") == 0 && has_value) {
+			args_valid = rt_set_mem_limit(argv[++i]);
+		} else if (strcmp(argv[i], "--timing") == 0) {
+			ctx.timing.enabled = true;
+		} else if (strcmp(argv[i], "--profile") == 0 && has_value) {
+			char* path = argv[++i];
+			if (!profile_init(path)) {
+				fprintf(stderr, "could not open %s: %s\n",
+					path, strerror(errno));
+				args_valid = false;
+			}
+		} else {
+			args_valid = false;
+		}
 	}
 
 	if (!args_valid) {
 		fprintf(stderr,
 			"USAGE: \n"
-			"\tpnc: enter repl mode\n"
-			"\tpnc [-s|--string] \"<program>\"\n");
+			"\tpnc [options]: enter repl mode\n"
+			"\tpnc [options] [-s|--string] \"<program>\"\n"
+			"\n"
+			"options: [--prec <bits>] [--mem-limit <size>] [--timing]\n"
+			"\t[--profile <file>]\n"
+			"\n"
+			"\t--prec sets the precision of reals, 53 bits by default,\n"
+			"\tin the repl :prec <bits> does the same\n"
+			"\t--mem-limit stops evaluations that need more than <size>\n"
+			"\tbytes (512k, 64m, 2g) with a memory error, like\n"
+			"\t:mem limit <size>, and :mem shows what they used\n"
+			"\t--timing prints how long each step of an evaluation took\n"
+			"\tto stderr, like :timing on, and :stats sums them up\n"
+			"\t--profile counts the calls of every builtin, with the\n"
+			"\ttypes of their arguments and how long they took, and\n"
+			"\twrites that to <file> as json on exit\n");
 		repl_quit();
 		return 0;
 	}
 
-	bool run_once = (argc == 3);
+	bool run_once = (prog != NULL);
 	if (run_once) {
-		// if argv == [pnc, -s|--string, "..."], evaluate argv[2]
-		repl_once(argv[2]);
+		// if -s|--string "..." was passed, evaluate it
+		repl_once(prog);
 	} else {
 		// if nothing was passed, start the repl (read from stdin in a loop)
 		ctx.is_running = true;
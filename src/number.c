@@ -1,10 +1,7 @@
 #include "number.h"
 
 Number number_integer_from_u32(uint32_t x) {
-    Number n = { .type = NUM_INTEGER };
-    mpz_init(n.integer_value);
-    mpz_set_ui(n.integer_value, x);
-    return n;
+    return num_small(x);
 }
 
 Number number_rational_from_u32s(uint32_t p, uint32_t q) {
@@ -29,33 +26,217 @@ Number number_real_from_d(double d) {
     return n;
 }
 
-void num_print(Number n) {
-    print_base_prefix(n.base);
+int num_integer_cmp(const Number* a, const Number* b) {
+    if (a->is_small && b->is_small) {
+        return (a->small_value > b->small_value)
+            - (a->small_value < b->small_value);
+    }
+
+    mpz_t va, vb;
+    mp_limb_t la, lb;
+    int c = mpz_cmp(num_z(a, va, &la), num_z(b, vb, &lb));
+    return (c > 0) - (c < 0);
+}
+
+int num_cmp(const Number* a, const Number* b) {
+    if (a->type == NUM_INTEGER && b->type == NUM_INTEGER) {
+        return num_integer_cmp(a, b);
+    }
+
+    // b is the wider one from here on
+    if (a->type > b->type) {
+        return -num_cmp(b, a);
+    }
+
+    mpz_t v;
+    mp_limb_t l;
+    int c = 0;
+
+    if (b->type == NUM_RATIONAL) {
+        c = (a->type == NUM_INTEGER)
+            ? -mpq_cmp_z(b->rational_value, num_z(a, v, &l))
+            : mpq_cmp(a->rational_value, b->rational_value);
+    } else if (a->type == NUM_INTEGER) {
+        c = -mpfr_cmp_z(b->real_value, num_z(a, v, &l));
+    } else if (a->type == NUM_RATIONAL) {
+        c = -mpfr_cmp_q(b->real_value, a->rational_value);
+    } else {
+        c = mpfr_cmp(a->real_value, b->real_value);
+    }
+    return (c > 0) - (c < 0);
+}
+
+Number* num_promote_small(Number* n) {
+    if (n->type == NUM_INTEGER && n->is_small) {
+        int64_t v = n->small_value;
+        n->is_small = false;
+        mpz_init_set_si(n->integer_value, v);
+    }
+    return n;
+}
+
+Number* num_demote_integer(Number* n) {
+    if (n->type == NUM_INTEGER && !n->is_small
+    && mpz_fits_slong_p(n->integer_value)) {
+        int64_t v = mpz_get_si(n->integer_value);
+        mpz_clear(n->integer_value);
+        n->is_small = true;
+        n->small_value = v;
+    }
+    return n;
+}
+
+void num_clear(Number n) {
     switch (n.type) {
-        case NUM_INTEGER: num_print_integer(n); break;
-        case NUM_RATIONAL: num_print_rational(n); break;
-        case NUM_REAL: num_print_real(n); break;
+        case NUM_INTEGER:
+            if (!n.is_small) {
+                mpz_clear(n.integer_value);
+            }
+            break;
+        case NUM_RATIONAL: mpq_clear(n.rational_value); break;
+        case NUM_REAL: mpfr_clear(n.real_value); break;
         default: break;
     }
 }
 
-void num_print_integer(Number n) {
-    mpz_out_str(stdout, n.base, n.integer_value);
+void num_write(dstr* out, Number n) {
+    write_base_prefix(out, n.base);
+    switch (n.type) {
+        case NUM_INTEGER: num_write_integer(out, n); break;
+        case NUM_RATIONAL: num_write_rational(out, n); break;
+        case NUM_REAL: num_write_real(out, n); break;
+        default: break;
+    }
 }
 
-void num_print_rational(Number n) {
-    mpq_out_str(stdout, n.base, n.rational_value);
+void num_write_integer(dstr* out, Number n) {
+    if (n.is_small && n.base == 10) {
+        // digits from the back, through uint64_t so INT64_MIN works too
+        char buf[24];
+        char* p = buf + sizeof(buf);
+        uint64_t v = (n.small_value < 0)
+            ? -(uint64_t)n.small_value
+            : (uint64_t)n.small_value;
+        do {
+            *--p = '0' + v % 10;
+            v /= 10;
+        } while (v != 0);
+        if (n.small_value < 0) {
+            *--p = '-';
+        }
+        dstr_append_len(*out, p, buf + sizeof(buf) - p);
+        return;
+    }
+
+    mpz_t view;
+    mp_limb_t limb;
+    mpz_srcptr z = num_z(&n, view, &limb);
+
+    // room for the digits, the sign and the '\0', mpz_sizeinbase may be
+    // one too big
+    dstr_reserve(*out, mpz_sizeinbase(z, n.base) + 2);
+    mpz_get_str(out->data + out->len, n.base, z);
+    out->len += strlen(out->data + out->len);
 }
 
-void num_print_real(Number n) {
-    // mpfr_printf("%Rg", n.real_value);
-    mpfr_out_str(stdout, n.base, 0, n.real_value, MPFR_RNDN);
+void num_write_rational(dstr* out, Number n) {
+    // same for both parts and the '/'
+    dstr_reserve(*out,
+        mpz_sizeinbase(mpq_numref(n.rational_value), n.base)
+        + mpz_sizeinbase(mpq_denref(n.rational_value), n.base) + 3);
+    mpq_get_str(out->data + out->len, n.base, n.rational_value);
+    out->len += strlen(out->data + out->len);
 }
 
-void print_base_prefix(uint8_t base) {
-    if (base == 2) fputs("0b", stdout);
-    else if (base == 8) fputs("0o", stdout);
-    else if (base == 16) fputs("0x", stdout);
+// the digits of mpfr_get_str(), reused by every num_write_real()
+static dstr real_digits;
+
+// same format as mpfr_out_str(stdout, base, 0, x, MPFR_RNDN): the digits
+// with a '.' after the first one and the exponent after 'e' (or '@' for
+// bases above 10)
+void num_write_real(dstr* out, Number n) {
+    mpfr_srcptr x = n.real_value;
+
+    if (mpfr_nan_p(x)) {
+        dstr_append(*out, "@NaN@");
+        return;
+    }
+    if (mpfr_inf_p(x)) {
+        dstr_append(*out, mpfr_sgn(x) > 0 ? "@Inf@" : "-@Inf@");
+        return;
+    }
+    if (mpfr_zero_p(x)) {
+        dstr_append(*out, mpfr_signbit(x) ? "-0" : "0");
+        return;
+    }
+
+    // mpfr_get_str wants room for the digits, the sign and the '\0', and
+    // at least 7 chars
+    size_t digits = mpfr_get_str_ndigits(n.base, mpfr_get_prec(x));
+    dstr_clear(real_digits);
+    dstr_reserve(real_digits, max(digits + 2, 7));
+
+    mpfr_exp_t e;
+    char* s = mpfr_get_str(real_digits.data, &e, n.base, digits, x,
+        MPFR_RNDN);
+
+    // room for the digits, the '.' and the exponent
+    dstr_reserve(*out, digits + 24);
+    if (*s == '-') {
+        out->data[out->len++] = *s++;
+    }
+    out->data[out->len++] = *s++;
+    out->data[out->len++] = '.';
+    int rest = strlen(s);
+    memcpy(out->data + out->len, s, rest);
+    out->len += rest;
+    out->len += sprintf(out->data + out->len,
+        (n.base <= 10) ? "e%ld" : "@%ld", (long)(e - 1));
+}
+
+void write_base_prefix(dstr* out, uint8_t base) {
+    if (base == 2) dstr_append(*out, "0b");
+    else if (base == 8) dstr_append(*out, "0o");
+    else if (base == 16) dstr_append(*out, "0x");
+}
+
+void num_print(Number n) {
+    static dstr scratch;
+    dstr_clear(scratch);
+    num_write(&scratch, n);
+    fwrite(scratch.data, 1, scratch.len, stdout);
+}
+
+// gmp and mpfr want terminated strings, literals shorter than this are
+// copied to the stack for them, longer ones to the heap
+#define NUM_STR_STACK 128
+
+// copy of str that ends in '\0', in buf if it fits
+// buf has to hold NUM_STR_STACK chars, free the copy with str_slice_free()
+static char* str_slice(char* str, int len, char* buf) {
+    char* slice = (len < NUM_STR_STACK) ? buf : malloc(len + 1);
+    if (slice == NULL) {
+        fputs("fatal: out of memory\n", stderr);
+        abort();
+    }
+    memcpy(slice, str, len);
+    slice[len] = '\0';
+    return slice;
+}
+
+#define str_slice_free(slice, buf) \
+    do { \
+        if ((slice) != (buf)) { \
+            free(slice); \
+        } \
+    } while(0)
+
+// value of c as a digit in bases up to 36, 36 if it is not one
+static inline int digit_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'Z') return c - 'A' + 10;
+    return 36;
 }
 
 bool num_from_str(char* str, int len, Number* out) {
@@ -86,78 +267,133 @@ bool num_from_str(char* str, int len, Number* out) {
         return false;
     }
 
-    int dot_count = 0; // '.'
-    int slash_count = 0; // '/'
-    // TODO count occurrences of :
-    // int e_count = 0; // 'e' or 'E'
-    // int minus_count = 0; // '-'
+    // one pass that finds the '/' or '.' and adds up the digits while they
+    // fit in an int64_t, then most literals need no gmp parsing at all
+    // the digits are added up negated, so that INT64_MIN fits too
+    bool neg = (str[0] == '-');
+    bool has_slash = false;
+    bool has_dot = false;
+    bool fits = true;
+    int64_t acc = 0;
+    int64_t num_acc = 0; // acc at the '/'
+    int digits = 0; // in the part after the last '/', or in all of str
+
+    for (int i = neg; i < len; i++) {
+        char c = str[i];
+
+        if (c == '/' || c == '.') {
+            // something like 5.3/2, 2.3.5 or 2//6
+            if (has_slash || has_dot) {
+                return false;
+            }
+            if (c == '.') {
+                has_dot = true;
+                continue;
+            }
+            has_slash = true;
+            fits = fits && digits > 0;
+            num_acc = acc;
+            acc = 0;
+            digits = 0;
+            continue;
+        }
 
-    for (int i = 0; i < len; i++) {
-        if (str[i] == '/') {
-            slash_count += 1;
-        } else if (str[i] == '.') {
-            dot_count += 1;
+        // small_mul() and small_sub() leave garbage on overflow, but then
+        // acc is never read again
+        if (fits) {
+            int d = digit_value(c);
+            fits = d < base
+                && small_mul(acc, base, &acc)
+                && small_sub(acc, d, &acc);
         }
+        digits++;
     }
+    fits = fits && digits > 0;
 
-    // something like 5.3/2 or -6/9.8
-    if (slash_count != 0 && dot_count != 0) {
-        return false;
+    if (has_dot) {
+        return num_real_from_str(str, len, out, base);
     }
 
-    if (dot_count == 1) {
-        return num_real_from_str(str, len, out, base);
-    } else if (dot_count > 1) { // "2.3.5"
-        return false;
+    if (!has_slash && fits && (neg || acc != INT64_MIN)) {
+        *out = num_small(neg ? acc : -acc);
+        out->base = base;
+        return true;
     }
 
-    if (slash_count == 1) {
-        return num_rational_from_str(str, len, out, base);
-    } else if (slash_count > 1) { // "2//6"
-        return false;
+    if (has_slash && fits) {
+        // the same as the slow path, which does not allow 0 either
+        if (acc == 0) {
+            return false;
+        }
+
+        Number n = { .type = NUM_RATIONAL, .base = base };
+        mpq_init(n.rational_value);
+        mpz_set_si(mpq_numref(n.rational_value), num_acc);
+        if (!neg) {
+            mpz_neg(mpq_numref(n.rational_value), mpq_numref(n.rational_value));
+        }
+        mpz_set_si(mpq_denref(n.rational_value), acc);
+        mpz_neg(mpq_denref(n.rational_value), mpq_denref(n.rational_value));
+        mpq_canonicalize(n.rational_value);
+
+        *out = n;
+        return true;
     }
 
+    // too big for an int64_t or not a plain number, gmp decides
+    if (has_slash) {
+        return num_rational_from_str(str, len, out, base);
+    }
     return num_integer_from_str(str, len, out, base);
 }
 
 bool num_integer_from_str(char* str, int len, Number* out, uint8_t base) {
-
-    // because set_str does not take a len argument, use this
-    char* str_slice = strndup(str, len);
+    char buf[NUM_STR_STACK];
+    char* slice = str_slice(str, len, buf);
 
     Number n = { .type = NUM_INTEGER, .base = base };
-    int retval = mpz_set_str(n.integer_value, str_slice, base);
+    mpz_init(n.integer_value);
+    int retval = mpz_set_str(n.integer_value, slice, base);
+    str_slice_free(slice, buf);
     if (retval == -1) {
+        num_clear(n);
         return false;
     }
 
-    *out = n;
+    *out = *num_demote_integer(&n);
     return true;
 }
 
 bool num_rational_from_str(char* str, int len, Number* out, uint8_t base) {
-
-    // because set_str does not take a len argument, use this
-    char* str_slice = strndup(str, len);
+    char buf[NUM_STR_STACK];
+    char* slice = str_slice(str, len, buf);
 
     Number n = { .type = NUM_RATIONAL, .base = base };
-    int retval = mpq_set_str(n.rational_value, str_slice, base);
-    if (retval == -1) {
+    mpq_init(n.rational_value);
+    int retval = mpq_set_str(n.rational_value, slice, base);
+    str_slice_free(slice, buf);
+    if (retval == -1 || mpz_sgn(mpq_denref(n.rational_value)) == 0) {
+        num_clear(n);
         return false;
     }
 
+    // mpq_set_str keeps 2/4 as it is, the mpq functions expect 1/2
+    mpq_canonicalize(n.rational_value);
+
     *out = n;
     return true;
 }
 
 bool num_real_from_str(char* str, int len, Number* out, uint8_t base) {
-
-    // because set_str does not take a len argument, use this
-    char* str_slice = strndup(str, len);
+    char buf[NUM_STR_STACK];
+    char* slice = str_slice(str, len, buf);
 
     Number n = { .type = NUM_REAL, .base = base };
-    int retval = mpfr_set_str(n.real_value, str_slice, base, MPFR_RNDN);
+    mpfr_init(n.real_value);
+    int retval = mpfr_set_str(n.real_value, slice, base, MPFR_RNDN);
+    str_slice_free(slice, buf);
     if (retval == -1) {
+        num_clear(n);
         return false;
     }
 
@@ -165,28 +401,21 @@ bool num_real_from_str(char* str, int len, Number* out, uint8_t base) {
     return true;
 }
 
-void Z_to_Q(mpz_t z, mpq_t q_out) {
-    mpq_init(q_out);
-    mpq_set_z(q_out, z);
-    mpq_canonicalize(q_out);
-}
-
-void Z_to_R(mpz_t z, mpfr_t r_out) {
-    mpfr_init(r_out);
-    mpfr_set_z(r_out, z, MPFR_RNDN);
-}
-
-void Q_to_R(mpq_t q, mpfr_t r_out) {
-    mpfr_init(r_out);
-    mpfr_set_q(r_out, q, MPFR_RNDN);
-}
-
 Number num_add(Number n1, Number n2) {
 
     uint8_t base = n1.base;
 
     Number result;
 
+    // checked before the dispatch, most additions end here
+    if (n1.is_small && n2.is_small
+    && small_add(n1.small_value, n2.small_value, &result.small_value)) {
+        result.type = NUM_INTEGER;
+        result.base = base;
+        result.is_small = true;
+        return result;
+    }
+
     if (n1.type == NUM_INTEGER && n2.type == NUM_INTEGER) {
         num_add_ZZ_Z(n1, n2, &result, base);
     }
@@ -229,101 +458,418 @@ Number num_add(Number n1, Number n2) {
 void num_add_ZZ_Z(Number n1, Number n2, Number* out, uint8_t out_base) {
     *out = (Number){ .type = NUM_INTEGER, .base = out_base };
 
+    // fast path, no gmp at all
+    if (n1.is_small && n2.is_small
+    && small_add(n1.small_value, n2.small_value, &out->small_value)) {
+        out->is_small = true;
+        return;
+    }
+
+    mpz_t v1, v2;
+    mp_limb_t l1, l2;
+
+    mpz_init(out->integer_value);
     mpz_add(out->integer_value,
-        n1.integer_value,
-        n2.integer_value);
+        num_z(&n1, v1, &l1),
+        num_z(&n2, v2, &l2));
+
+    num_demote_integer(out);
 }
 
 void num_add_ZQ_Q(Number n1, Number n2, Number* out, uint8_t out_base) {
-    mpq_t q1;
-    Z_to_Q(n1.integer_value, q1);
+    mpz_t v1;
+    mp_limb_t l1;
 
     *out = (Number){ .type = NUM_RATIONAL, .base = out_base };
+    mpq_init(out->rational_value);
 
-    mpq_add(out->rational_value,
-        q1,
-        n2.rational_value);
-
-    mpq_canonicalize(out->rational_value);
+    // z + a/b = (a + z*b) / b, still in lowest terms
+    mpz_ptr num = mpq_numref(out->rational_value);
+    mpz_mul(num, num_z(&n1, v1, &l1), mpq_denref(n2.rational_value));
+    mpz_add(num, num, mpq_numref(n2.rational_value));
+    mpz_set(mpq_denref(out->rational_value), mpq_denref(n2.rational_value));
 }
 
 void num_add_ZR_R(Number n1, Number n2, Number* out, uint8_t out_base) {
-    mpfr_t r1;
-    Z_to_R(n1.integer_value, r1);
+    mpz_t v1;
+    mp_limb_t l1;
 
     *out = (Number){ .type = NUM_REAL, .base = out_base };
+    mpfr_init(out->real_value);
 
-    mpfr_add(out->real_value,
-        r1,
+    mpfr_add_z(out->real_value,
         n2.real_value,
+        num_z(&n1, v1, &l1),
         MPFR_RNDN);
 }
 
 void num_add_QZ_Q(Number n1, Number n2, Number* out, uint8_t out_base) {
-    mpq_t q2;
-    Z_to_Q(n2.integer_value, q2);
-
-    *out = (Number){ .type = NUM_RATIONAL, .base = out_base };
-
-    mpq_add(out->rational_value,
-        n1.rational_value,
-        q2);
-
-    mpq_canonicalize(out->rational_value);
+    num_add_ZQ_Q(n2, n1, out, out_base);
 }
 
 void num_add_QQ_Q(Number n1, Number n2, Number* out, uint8_t out_base) {
 
     *out = (Number){ .type = NUM_RATIONAL, .base = out_base };
+    mpq_init(out->rational_value);
 
+    // the sum of two canonical fractions is canonical
     mpq_add(out->rational_value,
         n1.rational_value,
         n2.rational_value);
-
-    mpq_canonicalize(out->rational_value);
 }
 
 void num_add_QR_R(Number n1, Number n2, Number* out, uint8_t out_base) {
-    mpfr_t r1;
-    Q_to_R(n1.rational_value, r1);
-
     *out = (Number){ .type = NUM_REAL, .base = out_base };
+    mpfr_init(out->real_value);
 
-    mpfr_add(out->real_value,
-        r1,
+    mpfr_add_q(out->real_value,
         n2.real_value,
+        n1.rational_value,
         MPFR_RNDN);
 }
 
 void num_add_RZ_R(Number n1, Number n2, Number* out, uint8_t out_base) {
-    mpfr_t r2;
-    Z_to_R(n2.integer_value, r2);
+    mpz_t v2;
+    mp_limb_t l2;
 
     *out = (Number){ .type = NUM_REAL, .base = out_base };
+    mpfr_init(out->real_value);
 
-    mpfr_add(out->real_value,
+    mpfr_add_z(out->real_value,
         n1.real_value,
-        r2,
+        num_z(&n2, v2, &l2),
         MPFR_RNDN);
 }
 
 void num_add_RQ_R(Number n1, Number n2, Number* out, uint8_t out_base) {
-    mpfr_t r2;
-    Q_to_R(n2.rational_value, r2);
-
     *out = (Number){ .type = NUM_REAL, .base = out_base };
+    mpfr_init(out->real_value);
 
-    mpfr_add(out->real_value,
+    mpfr_add_q(out->real_value,
         n1.real_value,
-        r2,
+        n2.rational_value,
         MPFR_RNDN);
 }
 
 void num_add_RR_R(Number n1, Number n2, Number* out, uint8_t out_base) {
     *out = (Number){ .type = NUM_REAL, .base = out_base };
+    mpfr_init(out->real_value);
 
     mpfr_add(out->real_value,
         n1.real_value,
         n2.real_value,
         MPFR_RNDN);
 }
+
+// turns acc into a rational without changing its value
+// acc has to be an integer
+static void num_int_to_rational(Number* acc) {
+    mpz_t v;
+    mp_limb_t l;
+
+    Number q = { .type = NUM_RATIONAL, .base = acc->base };
+    mpq_init(q.rational_value);
+    mpq_set_z(q.rational_value, num_z(acc, v, &l));
+
+    num_clear(*acc);
+    *acc = q;
+}
+
+// acc = acc + x or acc * x, for an integer or rational acc and a real x
+// done with mpfr's mixed functions so the result is only rounded once
+static void num_real_op(Number* acc, const Number* x, bool mul) {
+    mpz_t v;
+    mp_limb_t l;
+
+    Number r = { .type = NUM_REAL, .base = acc->base };
+    mpfr_init(r.real_value);
+    if (acc->type == NUM_INTEGER) {
+        mpz_srcptr z = num_z(acc, v, &l);
+        if (mul) {
+            mpfr_mul_z(r.real_value, x->real_value, z, MPFR_RNDN);
+        } else {
+            mpfr_add_z(r.real_value, x->real_value, z, MPFR_RNDN);
+        }
+    } else {
+        mpq_srcptr q = acc->rational_value;
+        if (mul) {
+            mpfr_mul_q(r.real_value, x->real_value, q, MPFR_RNDN);
+        } else {
+            mpfr_add_q(r.real_value, x->real_value, q, MPFR_RNDN);
+        }
+    }
+
+    num_clear(*acc);
+    *acc = r;
+}
+
+void num_set(Number* dst, const Number* src) {
+    if (dst->type != src->type || dst->is_small || src->is_small) {
+        num_clear(*dst);
+        *dst = (Number){ .type = src->type, .base = src->base };
+
+        switch (src->type) {
+            case NUM_INTEGER:
+                if (src->is_small) {
+                    dst->is_small = true;
+                    dst->small_value = src->small_value;
+                    return;
+                }
+                mpz_init(dst->integer_value);
+                break;
+            case NUM_RATIONAL: mpq_init(dst->rational_value); break;
+            case NUM_REAL: mpfr_init(dst->real_value); break;
+        }
+    }
+
+    dst->base = src->base;
+    switch (src->type) {
+        case NUM_INTEGER:
+            mpz_set(dst->integer_value, src->integer_value);
+            break;
+        case NUM_RATIONAL:
+            mpq_set(dst->rational_value, src->rational_value);
+            break;
+        case NUM_REAL:
+            mpfr_set(dst->real_value, src->real_value, MPFR_RNDN);
+            break;
+    }
+}
+
+void num_add_into(Number* acc, const Number* x) {
+    mpz_t v;
+    mp_limb_t l;
+    int64_t small;
+
+    // the result type is the wider of the two, like num_add()
+    if (acc->type != NUM_REAL && x->type == NUM_REAL) {
+        num_real_op(acc, x, false);
+        return;
+    }
+    if (acc->type == NUM_INTEGER && x->type == NUM_RATIONAL) {
+        num_int_to_rational(acc);
+    }
+
+    switch (acc->type) {
+        case NUM_INTEGER:
+            // small is garbage on overflow, acc has to stay intact
+            if (acc->is_small && x->is_small
+            && small_add(acc->small_value, x->small_value, &small)) {
+                acc->small_value = small;
+                return;
+            }
+            num_promote_small(acc);
+            mpz_add(acc->integer_value, acc->integer_value,
+                num_z(x, v, &l));
+            num_demote_integer(acc);
+            break;
+
+        case NUM_RATIONAL:
+            if (x->type == NUM_INTEGER) {
+                // a/b + z = (a + z*b) / b, no gcd needed
+                mpz_addmul(mpq_numref(acc->rational_value),
+                    num_z(x, v, &l),
+                    mpq_denref(acc->rational_value));
+            } else {
+                mpq_add(acc->rational_value, acc->rational_value,
+                    x->rational_value);
+            }
+            break;
+
+        case NUM_REAL:
+            if (x->type == NUM_INTEGER) {
+                mpfr_add_z(acc->real_value, acc->real_value,
+                    num_z(x, v, &l), MPFR_RNDN);
+            } else if (x->type == NUM_RATIONAL) {
+                mpfr_add_q(acc->real_value, acc->real_value,
+                    x->rational_value, MPFR_RNDN);
+            } else {
+                mpfr_add(acc->real_value, acc->real_value,
+                    x->real_value, MPFR_RNDN);
+            }
+            break;
+    }
+}
+
+void num_sum_init(NumberSum* s) {
+    s->small = 0;
+    mpz_init(s->z);
+    s->has_rational = false;
+    mpz_init(s->q_num);
+    mpz_init(s->q_den);
+    s->q_den_limbs = 0;
+    s->has_real = false;
+    s->base = 0;
+}
+
+void num_sum_add(NumberSum* s, const Number* x) {
+    mpz_t v;
+    mp_limb_t l;
+    int64_t small;
+
+    if (s->base == 0) {
+        s->base = x->base;
+    }
+
+    switch (x->type) {
+        case NUM_INTEGER:
+            if (!x->is_small) {
+                mpz_add(s->z, s->z, x->integer_value);
+            } else if (small_add(s->small, x->small_value, &small)) {
+                s->small = small;
+            } else {
+                Number spill = num_small(s->small);
+                mpz_add(s->z, s->z, num_z(&spill, v, &l));
+                s->small = x->small_value;
+            }
+            break;
+
+        case NUM_RATIONAL: {
+            mpz_srcptr n = mpq_numref(x->rational_value);
+            mpz_srcptr d = mpq_denref(x->rational_value);
+
+            if (!s->has_rational) {
+                s->has_rational = true;
+                mpz_set(s->q_num, n);
+                mpz_set(s->q_den, d);
+                s->q_den_limbs = mpz_size(d);
+            }
+
+            // mostly the denominators repeat or divide each other, then
+            // the common one does not change
+            else if (mpz_cmp(s->q_den, d) == 0) {
+                mpz_add(s->q_num, s->q_num, n);
+            } else if (mpz_divisible_p(s->q_den, d)) {
+                mpz_t k;
+                mpz_init(k);
+                mpz_divexact(k, s->q_den, d);
+                mpz_addmul(s->q_num, n, k);
+                mpz_clear(k);
+            }
+
+            // a/b + n/d = (a*d + n*b) / (b*d)
+            else {
+                mpz_mul(s->q_num, s->q_num, d);
+                mpz_addmul(s->q_num, n, s->q_den);
+                mpz_mul(s->q_den, s->q_den, d);
+
+                // many different denominators would make q_den grow with
+                // every number, a gcd whenever it doubled keeps that in
+                // check and costs nothing when the denominators repeat
+                if (mpz_size(s->q_den) > 2 * s->q_den_limbs + 1) {
+                    mpz_t g;
+                    mpz_init(g);
+                    mpz_gcd(g, s->q_num, s->q_den);
+                    mpz_divexact(s->q_num, s->q_num, g);
+                    mpz_divexact(s->q_den, s->q_den, g);
+                    mpz_clear(g);
+                    s->q_den_limbs = mpz_size(s->q_den);
+                }
+            }
+            break;
+        }
+
+        case NUM_REAL:
+            if (!s->has_real) {
+                s->has_real = true;
+                mpfr_init(s->r);
+                mpfr_set(s->r, x->real_value, MPFR_RNDN);
+            } else {
+                mpfr_add(s->r, s->r, x->real_value, MPFR_RNDN);
+            }
+            break;
+    }
+}
+
+Number num_sum_finish(NumberSum* s) {
+    mpz_t v;
+    mp_limb_t l;
+    uint8_t base = s->base ? s->base : 10;
+
+    Number spill = num_small(s->small);
+    mpz_add(s->z, s->z, num_z(&spill, v, &l));
+
+    Number exact;
+    if (s->has_rational) {
+        // the only gcd for all the rationals
+        exact = (Number){ .type = NUM_RATIONAL, .base = base };
+        mpq_init(exact.rational_value);
+        mpz_addmul(s->q_num, s->z, s->q_den);
+        mpz_swap(mpq_numref(exact.rational_value), s->q_num);
+        mpz_swap(mpq_denref(exact.rational_value), s->q_den);
+        mpq_canonicalize(exact.rational_value);
+    } else {
+        exact = (Number){ .type = NUM_INTEGER, .base = base };
+        mpz_init(exact.integer_value);
+        mpz_swap(exact.integer_value, s->z);
+        num_demote_integer(&exact);
+    }
+    mpz_clear(s->z);
+    mpz_clear(s->q_num);
+    mpz_clear(s->q_den);
+
+    if (!s->has_real) {
+        return exact;
+    }
+
+    // takes over the mpfr of s
+    Number result = { .type = NUM_REAL, .base = base };
+    result.real_value[0] = s->r[0];
+    num_real_op(&exact, &result, false);
+    num_clear(result);
+    return exact;
+}
+
+void num_mul_into(Number* acc, const Number* x) {
+    mpz_t v;
+    mp_limb_t l;
+    int64_t small;
+
+    if (acc->type != NUM_REAL && x->type == NUM_REAL) {
+        num_real_op(acc, x, true);
+        return;
+    }
+    if (acc->type == NUM_INTEGER && x->type == NUM_RATIONAL) {
+        num_int_to_rational(acc);
+    }
+
+    switch (acc->type) {
+        case NUM_INTEGER:
+            // small is garbage on overflow, acc has to stay intact
+            if (acc->is_small && x->is_small
+            && small_mul(acc->small_value, x->small_value, &small)) {
+                acc->small_value = small;
+                return;
+            }
+            num_promote_small(acc);
+            mpz_mul(acc->integer_value, acc->integer_value,
+                num_z(x, v, &l));
+            num_demote_integer(acc);
+            break;
+
+        case NUM_RATIONAL:
+            if (x->type == NUM_INTEGER) {
+                mpz_mul(mpq_numref(acc->rational_value),
+                    mpq_numref(acc->rational_value),
+                    num_z(x, v, &l));
+                mpq_canonicalize(acc->rational_value);
+            } else {
+                mpq_mul(acc->rational_value, acc->rational_value,
+                    x->rational_value);
+            }
+            break;
+
+        case NUM_REAL:
+            if (x->type == NUM_INTEGER) {
+                mpfr_mul_z(acc->real_value, acc->real_value,
+                    num_z(x, v, &l), MPFR_RNDN);
+            } else if (x->type == NUM_RATIONAL) {
+                mpfr_mul_q(acc->real_value, acc->real_value,
+                    x->rational_value, MPFR_RNDN);
+            } else {
+                mpfr_mul(acc->real_value, acc->real_value,
+                    x->real_value, MPFR_RNDN);
+            }
+            break;
+    }
+}
@@ -1,6 +1,7 @@
 #ifndef NUMBER_H
 #define NUMBER_H
 
+#include <inttypes.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -26,7 +27,8 @@
 
 typedef enum {
 
-    // represented with one mpz
+    // represented with one mpz, or inline as an int64_t while it fits
+    // (see Number.is_small)
     NUM_INTEGER,
 
     // represented as an exact fraction (mpq)
@@ -44,9 +46,18 @@ typedef struct {
 
     uint8_t base;
 
+    // NUM_INTEGER only: the value is in small_value, integer_value is not
+    // initialized
+    // results go back to small whenever they fit, so a NUM_INTEGER that is
+    // not small never fits in an int64_t
+    bool is_small;
+
     union {
 
-        // NUM_INTEGER
+        // NUM_INTEGER, is_small
+        int64_t small_value;
+
+        // NUM_INTEGER, !is_small
         mpz_t integer_value;
 
         // NUM_RATIONAL
@@ -60,12 +71,65 @@ typedef struct {
 
 // ...
 
+// the small integer fast path reads an int64_t as a single gmp limb
+#if GMP_NUMB_BITS != 64
+#error "pnc needs 64 bit gmp limbs"
+#endif
+
+#define num_small(x) \
+    ((Number){ .type = NUM_INTEGER, .base = 10, .is_small = true, \
+        .small_value = (x) })
+
+// checked int64_t arithmetic for small integers
+// these return false on overflow, then the caller has to use gmp instead
+#define small_add(a, b, out) (!__builtin_add_overflow((a), (b), (out)))
+#define small_sub(a, b, out) (!__builtin_sub_overflow((a), (b), (out)))
+#define small_mul(a, b, out) (!__builtin_mul_overflow((a), (b), (out)))
+
+// read-only mpz view of an integer, no allocation
+// for a small integer the limb lives in *limb, so the view is only valid
+// while limb is, and must never be written to or cleared
+static inline mpz_srcptr num_z(const Number* n, mpz_t view, mp_limb_t* limb) {
+    if (!n->is_small) {
+        return n->integer_value;
+    }
+    int64_t v = n->small_value;
+    *limb = (v < 0) ? -(uint64_t)v : (uint64_t)v;
+    return mpz_roinit_n(view, limb, (v > 0) - (v < 0));
+}
+
+// -1, 0 or 1 like mpz_cmp, both have to be integers
+int num_integer_cmp(const Number* a, const Number* b);
+
+// same for any two numbers, compares the exact values
+// (a real is compared as the exact binary fraction it holds)
+int num_cmp(const Number* a, const Number* b);
+
+// -1, 0 or 1, n has to be an integer
+#define num_integer_sgn(n) \
+    ((n)->is_small \
+        ? ((n)->small_value > 0) - ((n)->small_value < 0) \
+        : mpz_sgn((n)->integer_value))
+
+// gives n an mpz, returns n
+Number* num_promote_small(Number* n);
+
+// turns n back into a small integer if it fits, returns n
+Number* num_demote_integer(Number* n);
+
+// frees the gmp data of n
+void num_clear(Number n);
+
+// appends the text of n to out, nothing is allocated once out and the
+// scratch buffer for reals are big enough
+void num_write(dstr* out, Number n);
+void num_write_integer(dstr* out, Number n);
+void num_write_rational(dstr* out, Number n);
+void num_write_real(dstr* out, Number n);
+void write_base_prefix(dstr* out, uint8_t base);
+
 // output directly to stdout
 void num_print(Number n);
-void num_print_integer(Number n);
-void num_print_rational(Number n);
-void num_print_real(Number n);
-void print_base_prefix(uint8_t base);
 
 // string conversion - generic versions
 
@@ -82,13 +146,6 @@ bool num_rational_from_str(char* str, int len, Number* out,
 bool num_real_from_str(char* str, int len, Number* out,
     uint8_t base);
 
-// conversion between gmp types
-// gmp requires that these functions use out params
-
-void Z_to_Q(mpz_t z, mpq_t q_out);
-void Z_to_R(mpz_t z, mpfr_t r_out);
-void Q_to_R(mpq_t q, mpfr_t r_out);
-
 // here Z means integer, Q means rational, R means real
 // binary operators will cast types like this:
 // Z + Z = Z
@@ -117,6 +174,59 @@ void num_add_RZ_R(Number n1, Number n2, Number* out, uint8_t out_base);
 void num_add_RQ_R(Number n1, Number n2, Number* out, uint8_t out_base);
 void num_add_RR_R(Number n1, Number n2, Number* out, uint8_t out_base);
 
+// destination passing versions, for folds like sum
+// acc has to hold a number already (num_small(0) is fine), it gets the
+// result and keeps its gmp memory, so a loop that folds into one
+// accumulator allocates nothing once acc is big enough
+// acc changes type like num_add() would and keeps its own base
+
+// dst = src
+void num_set(Number* dst, const Number* src);
+
+// acc = acc + x
+void num_add_into(Number* acc, const Number* x);
+
+// acc = acc * x
+void num_mul_into(Number* acc, const Number* x);
+
+// sum of many numbers of mixed types, without promoting at every step
+// every type has its own bucket and they are only combined by
+// num_sum_finish(), so a rational added to an integer never goes through
+// a conversion and a real never makes the exact numbers round
+typedef struct {
+    // integers, small ones in small until it would overflow
+    int64_t small;
+    mpz_t z;
+
+    // rationals, q_num / q_den is not reduced, q_den is a common multiple
+    // of every denominator added so far
+    bool has_rational;
+    mpz_t q_num;
+    mpz_t q_den;
+
+    // size of q_den after the last reduction, see num_sum_add()
+    size_t q_den_limbs;
+
+    // reals, added in order
+    bool has_real;
+    mpfr_t r;
+
+    // base of the first number, the result is printed in it like the
+    // result of num_add(), 0 before the first one
+    uint8_t base;
+} NumberSum;
+
+void num_sum_init(NumberSum* s);
+
+// s += x
+void num_sum_add(NumberSum* s, const Number* x);
+
+// adds the buckets together and frees s
+// the result has the type num_add_into() would have given: a real if
+// there was one, else a rational if there was one, else an integer
+// the exact part is rounded only once, when it is added to the reals
+Number num_sum_finish(NumberSum* s);
+
 // comparison operators
 
 #endif // NUMBER_H
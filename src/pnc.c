@@ -1,5 +1,12 @@
 #include "pnc.h"
 
+// global vars
+REPLContext ctx = {0};
+
+RT_FnList RT_BUILTIN_FUNCTIONS = {0};
+RT_VarList RT_CONSTANT_VARS = {0};
+ErrorString CPRV_ERROR_NAMES[] = {0};
+
 /*
 	TODO
 	- variables
@@ -105,15 +112,21 @@ TokenList tokenize(char* prog) {
 		char c = prog[i];
 
 		if (c == '(') {
-			tl_append(l, (Token){.type=T_OPEN_PAREN});
+			tl_append(l, (Token){.type=T_OPEN_PAREN, .offset=i});
 		} else if (c == ')') {
-			tl_append(l, (Token){.type=T_CLOSE_PAREN});
+			tl_append(l, (Token){.type=T_CLOSE_PAREN, .offset=i});
 		} else if (c == '\n' || isspace(c)) {
 			i++;
 			continue;
 		} else {
-			Token t = { .type=T_ATOM, .atom_str=&prog[i], .atom_len=1 };
-			while (prog[i] != '(' && prog[i] != ')' && !isspace(prog[i])) {
+			Token t = {
+				.type=T_ATOM,
+				.atom_str=&prog[i],
+				.atom_len=1,
+				.offset=i
+			};
+			while (prog[i] != '\0' && prog[i] != '(' && prog[i] != ')'
+			&& !isspace(prog[i])) {
 				t.atom_len++;
 				i++;
 			}
@@ -135,42 +148,108 @@ TokenList tokenize(char* prog) {
 	// or set x 5
 	// will not add if top level expression is already valid like
 	// (+ 5 6)
+	// same rule as parse_str()
 
-	if (l.len >= 2
-	&& l.tokens[0].type != T_OPEN_PAREN
-	&& l.tokens[l.len - 1].type != T_CLOSE_PAREN) {
+	if (l.len >= 2 && l.tokens[0].type == T_ATOM) {
 
 		TokenList l_wrapped = tl_new();
-		tl_append(l_wrapped, (Token){.type = T_OPEN_PAREN});
+		tl_append(l_wrapped, (Token){.type = T_OPEN_PAREN, .offset = 0});
 
 		for (int i = 0; i < l.len; i++) {
 			tl_append(l_wrapped, l.tokens[i]);
 		}
 
-		tl_append(l_wrapped, (Token){.type = T_CLOSE_PAREN});
+		tl_append(l_wrapped, (Token){.type = T_CLOSE_PAREN, .offset = n});
 		return l_wrapped;
 	}
 
 	return l;
 }
 
-void node_print_rec(ASTNode* node, int level) {
-	for (int i = 0; i < level; i++) {
-		putc('\t', stdout);
-		putc('|', stdout);
+Token lex_next(Lexer* lx) {
+	if (lx->has_peeked) {
+		lx->has_peeked = false;
+		return lx->peeked;
+	}
+
+	char* prog = lx->prog;
+	int i = lx->pos;
+
+	while (isspace(prog[i])) {
+		i++;
 	}
-	if (node->type == A_ATOM) {
-		printf("ASTNode<type=A_ATOM, \"%.*s\">\n",
-			node->atom_len,
-			node->atom_str);
-	} else if (node->type == A_LIST) {
-		printf("ASTNode<type=A_LIST, %d items>:\n",
-			node->list_len);
-		for (int i = 0; i < node->list_len; i++) {
-			node_print_rec(node->list_items[i], level + 1);
+
+	Token t = { .type = T_NONE, .offset = i };
+
+	if (prog[i] == '(') {
+		t.type = T_OPEN_PAREN;
+		i++;
+	} else if (prog[i] == ')') {
+		t.type = T_CLOSE_PAREN;
+		i++;
+	} else if (prog[i] != '\0') {
+		t.type = T_ATOM;
+		t.atom_str = &prog[i];
+		while (prog[i] != '\0' && prog[i] != '(' && prog[i] != ')'
+		&& !isspace(prog[i])) {
+			i++;
+		}
+		t.atom_len = &prog[i] - t.atom_str;
+	}
+
+	lx->pos = i;
+	return t;
+}
+
+Token lex_peek(Lexer* lx) {
+	if (!lx->has_peeked) {
+		lx->peeked = lex_next(lx);
+		lx->has_peeked = true;
+	}
+	return lx->peeked;
+}
+
+// a node that still has to be printed
+typedef struct {
+	ASTNode* node;
+	int level;
+} PrintFrame;
+
+void node_print_rec(ASTNode* root, int root_level) {
+	PrintFrame* todo = NULL;
+	int todo_len = 0;
+	int todo_cap = 0;
+
+	arena_grow(todo, todo_len, todo_cap, 16);
+	todo[todo_len++] = (PrintFrame){ root, root_level };
+
+	while (todo_len > 0) {
+		PrintFrame f = todo[--todo_len];
+		ASTNode* node = f.node;
+
+		for (int i = 0; i < f.level; i++) {
+			putc('\t', stdout);
+			putc('|', stdout);
+		}
+		if (node->type == A_ATOM) {
+			printf("ASTNode<type=A_ATOM, \"%.*s\">\n",
+				node->atom_len,
+				node->atom_str);
+		} else if (node->type == A_LIST) {
+			printf("ASTNode<type=A_LIST, %d items>:\n",
+				node->list_len);
+
+			// backwards, so the first item gets printed first
+			for (int i = node->list_len - 1; i >= 0; i--) {
+				arena_grow(todo, todo_len, todo_cap, 16);
+				todo[todo_len++] = (PrintFrame){
+					node->list_items[i],
+					f.level + 1
+				};
+			}
+		} else {
+			printf("ASTNode<type=A_UNIMPLEMENTED: see line %d>\n", __LINE__);
 		}
-	} else {
-		printf("ASTNode<type=A_UNIMPLEMENTED: see line %d>\n", __LINE__);
 	}
 }
 
@@ -185,50 +264,70 @@ ASTNode* make_ast_single(Token t) {
 
 ASTNode* make_ast_list_simple(TokenList tl) {
 
-	ASTNode* root = node_new();
-	root->type = A_LIST;
+	// stack of lists that have been opened but not closed yet,
+	// the innermost one is on top
+	ASTNode** open_lists = NULL;
+	int depth = 0;
+	int cap = 0;
 
-	// level of nesting 0 ( 1 ( 2 ... ))
-	int level = 1;
+	ASTNode* root = NULL;
 
-	for (int i = 1; i < tl.len-1; i++) {
+	for (int i = 0; i < tl.len; i++) {
+		Token t = tl.tokens[i];
 
-		if (tl.tokens[i].type == T_ATOM && tl.tokens[i].atom_len != 0) {
-			list_append(root, make_ast_single(tl.tokens[i]));
+		if (depth == 0 && root != NULL) {
+			// something like (+ 1 2) 3
+			eval_panic(RV_PARSE_ERROR,
+				"unexpected token after ')' at offset %d", t.offset);
 		}
 
-		else if (tl.tokens[i].type == T_OPEN_PAREN) {
-			// find matching close paren
+		if (t.type == T_ATOM && t.atom_len != 0) {
+			list_append(open_lists[depth - 1], make_ast_single(t));
+		}
 
-			int j = i;
-			while (level > 0 && j < tl.len-1) {
-				if (tl.tokens[j].type == T_OPEN_PAREN) {
-					level++;
-				} else if (tl.tokens[j].type == T_CLOSE_PAREN) {
-					level--;
-					if (level == 1) {
-						// matching close paren was found, index=j
-						break;
-					}
-				}
-				j++;
+		else if (t.type == T_OPEN_PAREN) {
+			ASTNode* node = node_new();
+			node->type = A_LIST;
+
+			if (depth == 0) {
+				root = node;
+			} else {
+				list_append(open_lists[depth - 1], node);
 			}
 
-			// reached end without level=0 again
-			if (i >= tl.len - 1) {
-				childproc_panic(RV_PARSE_ERROR, "unbalanced parentheses");
+			if (depth == cap) {
+				int new_cap = max(16, 2 * cap);
+				open_lists = arena_realloc(&ctx.arena, open_lists,
+					sizeof(ASTNode*) * cap, sizeof(ASTNode*) * new_cap);
+				cap = new_cap;
 			}
+			open_lists[depth++] = node;
+		}
 
-			// now i = index of open paren
-			// j = index of matching close paren
+		else if (t.type == T_CLOSE_PAREN) {
+			if (depth == 0) {
+				eval_panic(RV_PARSE_ERROR,
+					"unbalanced parentheses: unmatched ')' at offset %d",
+					t.offset);
+			}
+			depth--;
+		}
+	}
 
-			TokenList sublist = {
-				.tokens = tl.tokens + i,
-				.len = j - i + 1
-			};
-			list_append(root, make_ast_list_simple(sublist));
-			// magic
-			i = j;
+	if (depth != 0) {
+		// report the innermost paren that was never closed
+		int unclosed = 0;
+		for (int i = tl.len - 1; i >= 0; i--) {
+			if (tl.tokens[i].type == T_CLOSE_PAREN) {
+				unclosed++;
+			} else if (tl.tokens[i].type == T_OPEN_PAREN) {
+				if (unclosed == 0) {
+					eval_panic(RV_PARSE_ERROR,
+						"unbalanced parentheses: unmatched '(' at offset %d",
+						tl.tokens[i].offset);
+				}
+				unclosed--;
+			}
 		}
 	}
 
@@ -244,12 +343,13 @@ ASTNode* make_ast(TokenList tl) {
 		return make_ast_single(tl.tokens[0]);
 	}
 
-	else if (tl.tokens[0].type == T_OPEN_PAREN && tl.tokens[tl.len - 1].type == T_CLOSE_PAREN) {
+	// also reports unbalanced parens
+	else if (tl.tokens[0].type != T_ATOM) {
 		return make_ast_list_simple(tl);
 	}
 
 	else {
-		childproc_panic(RV_PARSE_ERROR, "unrecognized expression");
+		eval_panic(RV_PARSE_ERROR, "unrecognized expression");
 	}
 }
 
@@ -274,6 +374,59 @@ bool ast_matches_ident(ASTNode* ast, E_Ident* out) {
 	return true;
 }
 
+// FNV-1a
+static uint32_t rt_hash_name(char* name, int name_len) {
+	uint32_t h = 2166136261u;
+	for (int i = 0; i < name_len; i++) {
+		h ^= (uint8_t)name[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+void rt_fnlist_build_index(RT_FnList* l) {
+	int cap = 16;
+	while (cap < 2 * l->num_fns) {
+		cap *= 2;
+	}
+
+	free(l->index);
+	l->index = malloc(sizeof(int) * cap);
+	l->index_cap = cap;
+	memset(l->index, -1, sizeof(int) * cap);
+
+	for (int i = 0; i < l->num_fns; i++) {
+		uint32_t slot = rt_hash_name(l->fns[i].name, l->fns[i].name_len)
+			& (cap - 1);
+		while (l->index[slot] != -1) {
+			slot = (slot + 1) & (cap - 1);
+		}
+		l->index[slot] = i;
+	}
+}
+
+int rt_find_func(char* name, int name_len) {
+	RT_FnList* l = &RT_BUILTIN_FUNCTIONS;
+	if (l->index == NULL) {
+		return -1;
+	}
+
+	uint32_t slot = rt_hash_name(name, name_len) & (l->index_cap - 1);
+
+	// the table is never more than half full, so this always finds an
+	// empty slot eventually
+	while (l->index[slot] != -1) {
+		E_FuncData* fd = &l->fns[l->index[slot]];
+		if (fd->name_len == name_len
+		&& memcmp(fd->name, name, name_len) == 0) {
+			return l->index[slot];
+		}
+		slot = (slot + 1) & (l->index_cap - 1);
+	}
+
+	return -1;
+}
+
 bool ast_matches_funccall(ASTNode* ast, E_FuncCall* out) {
 	if (ast->type != A_LIST
 	|| ast->list_len == 0
@@ -281,137 +434,484 @@ bool ast_matches_funccall(ASTNode* ast, E_FuncCall* out) {
 		return false;
 	}
 
-	for (int i = 0; i < RT_BUILTIN_FUNCTIONS.num_fns; i++) {
-		E_FuncData* fd = &RT_BUILTIN_FUNCTIONS.fns[i];
+	int func_index = rt_find_func(
+		ast->list_items[0]->atom_str,
+		ast->list_items[0]->atom_len);
 
-		if (strncmp(
-			ast->list_items[0]->atom_str,
-			fd->name,
-			fd->name_len) != 0)
-		{
+	if (func_index == -1) {
+		eval_panic(RV_NAME_ERROR, "undefined function '%.*s'",
+			ast->list_items[0]->atom_len,
+			ast->list_items[0]->atom_str);
+	}
+
+	out->func_index = func_index;
+	out->num_args_passed = ast->list_len - 1;
+	out->args = arena_alloc(&ctx.arena,
+		out->num_args_passed * sizeof(Expr*));
+
+	return true;
+}
+
+// an ast node that still has to be turned into an expr, and where to put it
+typedef struct {
+	ASTNode* ast;
+	Expr** out;
+} ParseTask;
+
+Expr* parse(ASTNode* root) {
+
+	if (root == NULL) {
+		eval_panic(RV_OK_EMPTY, "");
+	}
+
+	Expr* result = NULL;
+
+	ParseTask* todo = NULL;
+	int todo_len = 0;
+	int todo_cap = 0;
+
+	arena_grow(todo, todo_len, todo_cap, 16);
+	todo[todo_len++] = (ParseTask){ root, &result };
+
+	while (todo_len > 0) {
+		ParseTask task = todo[--todo_len];
+		ASTNode* ast = task.ast;
+
+		Expr* e = expr_new();
+		*task.out = e;
+
+		if (ast_matches_number(ast, &e->number)) {
+			e->type = E_NUMBER;
+			continue;
+		}
+		
+		if (ast_matches_ident(ast, &e->ident)) {
+			e->type = E_IDENT;
 			continue;
 		}
 
-		// at this point, function name matches
+		if (ast_matches_funccall(ast, &e->funccall)) {
+			e->type = E_FUNCCALL;
 
-		out->func = *fd;
-		out->num_args_passed = ast->list_len - 1;
-		out->args = malloc(out->num_args_passed * sizeof(Expr*));
-		
-		for (int i = 0; i < out->num_args_passed; i++) {
-			out->args[i] = parse(ast->list_items[i + 1]);
+			// backwards, so the first argument gets parsed first
+			for (int i = e->funccall.num_args_passed - 1; i >= 0; i--) {
+				arena_grow(todo, todo_len, todo_cap, 16);
+				todo[todo_len++] = (ParseTask){
+					ast->list_items[i + 1],
+					&e->funccall.args[i]
+				};
+			}
+			continue;
 		}
 
-		return true;
+		eval_panic(RV_PARSE_ERROR, "unrecognized expression");
 	}
 
-	childproc_panic(RV_NAME_ERROR, "undefined function '%.*s'",
-		ast->list_items[0]->atom_len,
-		ast->list_items[0]->atom_str);
+	return result;
 }
 
-Expr* parse(ASTNode* ast) {
-
+Expr* parse_atom(char* atom_str, int atom_len) {
 	Expr* e = expr_new();
 
-	if (ast == NULL) {
-		childproc_panic(RV_OK_EMPTY, "");
+	if (num_from_str(atom_str, atom_len, &e->number)) {
+		e->type = E_NUMBER;
+	} else {
+		e->type = E_IDENT;
+		e->ident.name = atom_str;
+		e->ident.len = atom_len;
 	}
 
-	if (ast_matches_number(ast, &e->number)) {
-		e->type = E_NUMBER;
-		return e;
+	return e;
+}
+
+// a function call whose ')' has not been reached yet
+typedef struct {
+	Expr* call;
+	Expr** args;
+	int num_args;
+	int args_cap;
+
+	// where the '(' was, for error messages
+	int offset;
+} ParseFrame;
+
+// adds e as the next argument of the call on top of the stack
+static void parse_frame_append(ParseFrame* f, Expr* e) {
+	if (f->num_args == f->args_cap) {
+		int new_cap = max(4, 2 * f->args_cap);
+		f->args = arena_realloc(&ctx.arena, f->args,
+			sizeof(Expr*) * f->args_cap, sizeof(Expr*) * new_cap);
+		f->args_cap = new_cap;
 	}
-	
-	if (ast_matches_ident(ast, &e->ident)) {
-		e->type = E_IDENT;
-		return e;
-	}
-
-	if (ast_matches_funccall(ast, &e->funccall)) {
-		e->type = E_FUNCCALL;
-		return e;
-	}
-
-	childproc_panic(RV_PARSE_ERROR, "unrecognized expression");
-}
-
-// void expr_print_rec(Expr* e) {
-// 	if (e->type == E_NUMBER) {
-// 		printf("(num %lf)", e->number.value);
-// 	} else if (e->type == E_FUNCCALL) {
-// 		printf("(%.*s ",
-// 			e->funccall.func.name_len,
-// 			e->funccall.func.name);
-//
-// 		for (int i = 0; i < e->funccall.num_args_passed; i++) {
-// 			expr_print_rec(e->funccall.args[i]);
-//
-// 			if (i != e->funccall.num_args_passed - 1) {
-// 				putc(' ', stdout);
-// 			}
-//
-// 		}
-//
-// 		putc(')', stdout);
-//
-// 	} else if (e->type == E_IDENT) {
-// 		printf("%.*s", e->ident.len, e->ident.name);
-// 	} else {
-// 		putc('?', stdout);
-// 	}
-// }
+	f->args[f->num_args++] = e;
+}
+
+Expr* parse_str(char* prog) {
+	Lexer lx = lexer_new(prog);
+
+	Token t = lex_next(&lx);
+	if (t.type == T_NONE) {
+		return NULL;
+	}
+
+	// calls that are still open, innermost on top
+	ParseFrame* stack = NULL;
+	int depth = 0;
+	int cap = 0;
+
+	// add () at top-level if necessary
+	// this avoids syntax errors for simple expressions like + 1 3
+	// will not add if the input is a single atom or starts with (
+	bool wrapped = (t.type == T_ATOM && lex_peek(&lx).type != T_NONE);
+	int base_depth = wrapped ? 1 : 0;
+
+	Expr* result = NULL;
+
+	for (; t.type != T_NONE; t = lex_next(&lx)) {
+
+		if (result != NULL) {
+			// something like (+ 1 2) 3
+			eval_panic(RV_PARSE_ERROR,
+				"unexpected token after ')' at offset %d", t.offset);
+		}
+
+		Expr* done = NULL;
+
+		if (t.type == T_ATOM && (depth > 0 || !wrapped)) {
+			done = parse_atom(t.atom_str, t.atom_len);
+		}
+
+		else if (t.type == T_OPEN_PAREN || t.type == T_ATOM) {
+			// start of a call, either a real '(' or the implicit one
+			// that wraps the whole input
+			Token name = t;
+			int offset = t.offset;
+
+			if (t.type == T_OPEN_PAREN) {
+				name = lex_next(&lx);
+				if (name.type == T_NONE) {
+					eval_panic(RV_PARSE_ERROR,
+						"unbalanced parentheses: unmatched '(' at offset %d",
+						offset);
+				}
+				if (name.type != T_ATOM) {
+					eval_panic(RV_PARSE_ERROR, "unrecognized expression");
+				}
+			}
+
+			int func_index = rt_find_func(name.atom_str, name.atom_len);
+			if (func_index == -1) {
+				eval_panic(RV_NAME_ERROR, "undefined function '%.*s'",
+					name.atom_len,
+					name.atom_str);
+			}
+
+			Expr* call = expr_new();
+			call->type = E_FUNCCALL;
+			call->funccall.func_index = func_index;
+
+			if (depth == cap) {
+				int new_cap = max(16, 2 * cap);
+				stack = arena_realloc(&ctx.arena, stack,
+					sizeof(ParseFrame) * cap, sizeof(ParseFrame) * new_cap);
+				cap = new_cap;
+			}
+			stack[depth++] = (ParseFrame){ .call = call, .offset = offset };
+		}
+
+		else if (t.type == T_CLOSE_PAREN) {
+			if (depth == base_depth) {
+				eval_panic(RV_PARSE_ERROR,
+					"unbalanced parentheses: unmatched ')' at offset %d",
+					t.offset);
+			}
+
+			ParseFrame* f = &stack[--depth];
+			f->call->funccall.args = f->args;
+			f->call->funccall.num_args_passed = f->num_args;
+			done = f->call;
+		}
+
+		if (done != NULL) {
+			if (depth == 0) {
+				result = done;
+			} else {
+				parse_frame_append(&stack[depth - 1], done);
+			}
+		}
+	}
+
+	if (depth > base_depth) {
+		eval_panic(RV_PARSE_ERROR,
+			"unbalanced parentheses: unmatched '(' at offset %d",
+			stack[depth - 1].offset);
+	}
+
+	if (wrapped) {
+		ParseFrame* f = &stack[0];
+		f->call->funccall.args = f->args;
+		f->call->funccall.num_args_passed = f->num_args;
+		result = f->call;
+	}
+
+	return result;
+}
+
+// a call that is being printed
+typedef struct {
+	Expr* e;
+	int next_arg;
+} ExprPrintFrame;
+
+void expr_write(dstr* out, Expr* root) {
+	ExprPrintFrame* todo = NULL;
+	int todo_len = 0;
+	int todo_cap = 0;
+
+	Expr* next = root;
+	while (true) {
+		if (next != NULL) {
+			if (next->type == E_NUMBER) {
+				num_write(out, next->number);
+			} else if (next->type == E_IDENT) {
+				dstr_append_len(*out, next->ident.name, next->ident.len);
+			} else if (next->type == E_FUNCCALL) {
+				E_FuncData* fd = funccall_data(next);
+				dstr_append_char(*out, '(');
+				dstr_append_len(*out, fd->name, fd->name_len);
+
+				arena_grow(todo, todo_len, todo_cap, 16);
+				todo[todo_len++] = (ExprPrintFrame){ next, 0 };
+			} else {
+				dstr_append_char(*out, '?');
+			}
+			next = NULL;
+		}
+
+		if (todo_len == 0) {
+			break;
+		}
+
+		ExprPrintFrame* f = &todo[todo_len - 1];
+		if (f->next_arg < f->e->funccall.num_args_passed) {
+			dstr_append_char(*out, ' ');
+			next = f->e->funccall.args[f->next_arg++];
+		} else {
+			dstr_append_char(*out, ')');
+			todo_len--;
+		}
+	}
+
+	arena_pop(&ctx.arena, todo);
+}
+
+void expr_print_rec(Expr* e) {
+	dstr s = dstr_new();
+	expr_write(&s, e);
+	fputs(s.data, stdout);
+	dstr_free(s);
+}
 
 void assert_funccall_arg_count_correct(Expr* e) {
-	if (e->funccall.func.num_args == RTFN_VARARGS
-	|| e->funccall.func.num_args == e->funccall.num_args_passed) {
+	E_FuncData* fd = funccall_data(e);
+
+	if (fd->num_args == RTFN_VARARGS
+	|| fd->num_args == e->funccall.num_args_passed) {
 		return;
 	}
 
-	childproc_panic(RV_VALUE_ERROR,
+	eval_panic(RV_VALUE_ERROR,
 		"function '%.*s' got %d arguments, expected %d",
-		e->funccall.func.name_len,
-		e->funccall.func.name,
+		fd->name_len,
+		fd->name,
 		e->funccall.num_args_passed,
-		e->funccall.func.num_args);
+		fd->num_args);
 }
 
-Value try_eval_arg_as_type(Expr* e, int arg_num, ValueType type) {
+void assert_arg_type_correct(E_FuncData* fd, int arg_num, Value v) {
+
+	// varargs functions have one type for all arguments
+	ValueType type = (fd->num_args == RTFN_VARARGS)
+		? fd->arg_types[0]
+		: fd->arg_types[arg_num];
 
-	E_FuncData fd = e->funccall.func;
-	Value v = eval(e->funccall.args[arg_num]);
+	// a range is a list that was not materialized
+	bool matches = (v.type == type)
+		|| (type == V_LIST && value_is_list(v));
 
-	if (v.type != type) {
-		childproc_panic(RV_VALUE_ERROR,
+	if (!matches) {
+		eval_panic(RV_VALUE_ERROR,
 			"argument #%d of function '%.*s' is type %s, expected %s",
 			arg_num,
-			fd.name_len,
-			fd.name,
+			fd->name_len,
+			fd->name,
 			stringify_value_type(v.type),
 			stringify_value_type(type));
 	}
-
-	return v;
 }
 
-Value eval_constant(Expr* e) {
+int rt_find_constant(char* name, int name_len) {
 	for (int i = 0; i < RT_CONSTANT_VARS.num_vars; i++) {
 		VarData* vd = &RT_CONSTANT_VARS.vars[i];
-		if (!strncmp(
-			vd->name,
-			e->ident.name,
-			e->ident.len))
-		{
+		if ((int)strlen(vd->name) == name_len
+		&& memcmp(vd->name, name, name_len) == 0) {
 			// names match
-			return vd->value;
+			return i;
 		}
 	}
-	childproc_panic(RV_NAME_ERROR, "undefined constant %.*s",
-		e->ident.len,
-		e->ident.name);
+	return -1;
 }
 
-Value eval(Expr* e) {
+Value eval_constant(Expr* e) {
+	int i = rt_find_constant(e->ident.name, e->ident.len);
+	if (i == -1) {
+		eval_panic(RV_NAME_ERROR, "undefined constant %.*s",
+			e->ident.len,
+			e->ident.name);
+	}
+	return rt_constant_value(i);
+}
+
+// computed constants at the precisions they were used at
+// entries of the current precision are never replaced, so a value handed
+// out during an evaluation stays valid until it ends
+#define CONST_CACHE_SIZE 16
+
+typedef struct {
+	bool used;
+	int var;
+	mpfr_t value;
+} ConstCacheEntry;
+
+static ConstCacheEntry const_cache[CONST_CACHE_SIZE];
+static int const_cache_next; // slot to replace next, oldest first
+
+Value rt_constant_value(int i) {
+	VarData* vd = &RT_CONSTANT_VARS.vars[i];
+	if (vd->compute == NULL) {
+		return vd->value;
+	}
+
+	mpfr_prec_t prec = mpfr_get_default_prec();
+	ConstCacheEntry* e = NULL;
+	for (int k = 0; k < CONST_CACHE_SIZE; k++) {
+		if (const_cache[k].used && const_cache[k].var == i
+		&& mpfr_get_prec(const_cache[k].value) == prec) {
+			e = &const_cache[k];
+			break;
+		}
+	}
+
+	if (e == NULL) {
+		// there are fewer constants than slots, one always has another
+		// precision or is free
+		for (int k = 0; e == NULL; k++) {
+			ConstCacheEntry* c = &const_cache[
+				(const_cache_next + k) % CONST_CACHE_SIZE];
+			if (!c->used || mpfr_get_prec(c->value) != prec) {
+				e = c;
+				const_cache_next = (e - const_cache + 1) % CONST_CACHE_SIZE;
+			}
+		}
+
+		// kept across evaluations, so not in the arena
+		bool use_arena = ctx.gmp_use_arena;
+		ctx.gmp_use_arena = false;
+		if (e->used) {
+			mpfr_clear(e->value);
+		}
+		mpfr_init2(e->value, prec);
+		vd->compute(e->value);
+		ctx.gmp_use_arena = use_arena;
+
+		e->used = true;
+		e->var = i;
+	}
+
+	Value v = { .type = V_NUM };
+	v.number_value = (Number){ .type = NUM_REAL, .base = 10 };
+	v.number_value.real_value[0] = e->value[0];
+	return v;
+}
+
+void rt_constant_cache_clear() {
+	for (int k = 0; k < CONST_CACHE_SIZE; k++) {
+		if (const_cache[k].used) {
+			mpfr_clear(const_cache[k].value);
+			const_cache[k].used = false;
+		}
+	}
+}
+
+static void const_pi(mpfr_ptr out) {
+	mpfr_const_pi(out, MPFR_RNDN);
+}
+
+static void const_e(mpfr_ptr out) {
+	mpfr_set_ui(out, 1, MPFR_RNDN);
+	mpfr_exp(out, out, MPFR_RNDN);
+}
+
+bool rt_set_prec(char* bits) {
+	char* end;
+	long prec = strtol(bits, &end, 10);
+	end += strspn(end, " \t\r\n");
+	if (end == bits || *end != '\0'
+	|| prec < MPFR_PREC_MIN || prec > PREC_MAX) {
+		return false;
+	}
+
+	mpfr_set_default_prec(prec);
+	return true;
+}
+
+void mem_limit_panic() {
+	eval_panic(RV_MEMORY_ERROR,
+		"evaluation needs more than the memory limit of %zu bytes",
+		ctx.mem_limit);
+}
+
+// the evaluation arena calls this instead of going over the limit
+static void arena_over_limit(Arena* a, size_t size) {
+	(void)a;
+	(void)size;
+	mem_limit_panic();
+}
+
+bool mem_fits(size_t size) {
+	// without room in the current chunk the arena needs a new one
+	ArenaChunk* c = ctx.arena.current;
+	bool in_chunk = c != NULL && c->size - c->used >= size;
+	return mem_heap_fits(in_chunk ? 0 : size);
+}
+
+bool rt_set_mem_limit(char* size) {
+	char* end;
+	errno = 0;
+	unsigned long long n = strtoull(size, &end, 10);
+	if (end == size || errno != 0 || *size == '-') {
+		return false;
+	}
+
+	int shift = 0;
+	switch (tolower(*end)) {
+		case 'k': shift = 10; end++; break;
+		case 'm': shift = 20; end++; break;
+		case 'g': shift = 30; end++; break;
+	}
+	end += strspn(end, " \t\r\n");
+	if (*end != '\0' || n > (SIZE_MAX >> shift)) {
+		return false;
+	}
+
+	// eval_pnc_expr() passes it on to the arena
+	ctx.mem_limit = (size_t)n << shift;
+	ctx.arena.over_limit = arena_over_limit;
+	return true;
+}
+
+// evaluates a number or an identifier
+static Value eval_leaf(Expr* e) {
 	if (e->type == E_NUMBER) {
 		return (Value){
 			.type = V_NUM,
@@ -421,7 +921,7 @@ Value eval(Expr* e) {
 
 	if (e->type == E_IDENT) {
 		if (e->ident.len == 0) {
-			childproc_panic(RV_OTHER_ERROR, "something bad happened on line %d",
+			eval_panic(RV_OTHER_ERROR, "something bad happened on line %d",
 				__LINE__);
 		}
 
@@ -430,18 +930,298 @@ Value eval(Expr* e) {
 			return eval_constant(e);
 		}
 		
-		childproc_panic(RV_NAME_ERROR, "'%.*s' is unknown",
+		eval_panic(RV_NAME_ERROR, "'%.*s' is unknown",
 			e->ident.len,
 			e->ident.name);
 	}
 
-	if (e->type == E_FUNCCALL) {
-		assert_funccall_arg_count_correct(e);
-		return e->funccall.func.actual_function(e);
+	eval_panic(RV_OTHER_ERROR,
+		"something bad happened on line %d", __LINE__);
+}
+
+// a call whose arguments are being evaluated
+typedef struct EvalFrame {
+	Expr* e;
+
+	// index of the next argument to evaluate
+	int next_arg;
+
+	// the arguments are in ctx.eval_stack starting at this index
+	int base;
+} EvalFrame;
+
+Value eval(Expr* root) {
+	return eval_hooked(root, NULL);
+}
+
+Value eval_hooked(Expr* root, EvalHooks* hooks) {
+	int depth = 0;
+	int sp = 0;
+
+	// the next expr to evaluate, NULL when the top frame should continue
+	Expr* next = root;
+
+	while (true) {
+		Value v;
+
+		if (next != NULL && hooks != NULL) {
+			hooks->enter(hooks->data, next);
+		}
+
+		if (next != NULL && next->type != E_FUNCCALL) {
+			v = eval_leaf(next);
+			next = NULL;
+		}
+
+		else if (next != NULL) {
+			assert_funccall_arg_count_correct(next);
+
+			heap_grow(ctx.eval_frames, depth, ctx.eval_frames_cap, 64);
+			ctx.eval_frames[depth++] = (EvalFrame){ .e = next, .base = sp };
+			next = NULL;
+			continue;
+		}
+
+		else {
+			EvalFrame* f = &ctx.eval_frames[depth - 1];
+			E_FuncCall* call = &f->e->funccall;
+
+			if (f->next_arg < call->num_args_passed) {
+				next = call->args[f->next_arg];
+				continue;
+			}
+
+			// every argument is on the stack, make the call
+			v = call_builtin(funccall_data(f->e),
+				&ctx.eval_stack[f->base],
+				call->num_args_passed);
+			mem_check();
+			sp = f->base;
+			depth--;
+		}
+
+		if (hooks != NULL) {
+			hooks->leave(hooks->data, v);
+		}
+
+		// v is done, it is either the result or an argument of the top frame
+
+		if (depth == 0) {
+			return v;
+		}
+
+		EvalFrame* f = &ctx.eval_frames[depth - 1];
+		assert_arg_type_correct(funccall_data(f->e), f->next_arg, v);
+
+		heap_grow(ctx.eval_stack, sp, ctx.eval_stack_cap, 64);
+		ctx.eval_stack[sp++] = v;
+		f->next_arg++;
+	}
+}
+
+// what explain() measured for one node of the expr tree
+typedef struct NodeStats {
+	Value result;
+
+	// inclusive, the node and everything below it
+	// hold the counters at the start while the node is evaluated
+	uint64_t ns;
+	size_t allocs; // gmp allocs and reallocs
+	size_t bytes; // taken from the arena
+
+	// the part of the above that the children took
+	uint64_t child_ns;
+	size_t child_allocs;
+	size_t child_bytes;
+
+	// the call this node is an argument of, -1 for the root
+	int parent;
+} NodeStats;
+
+// the nodes explain() has measured so far, in ctx.explain_nodes
+typedef struct {
+	int num_nodes;
+
+	// the node being evaluated, -1 when there is none
+	int open;
+} Analysis;
+
+#define gmp_alloc_count() \
+	(ctx.gmp_stats.allocs + ctx.gmp_stats.reallocs)
+
+// the nodes are numbered in pre-order, the order expr_write() visits them
+// in, and kept on the heap so only the evaluation itself is measured
+static void analyze_enter(void* data, Expr* e) {
+	(void)e;
+	Analysis* a = data;
+	int node = a->num_nodes++;
+	heap_grow(ctx.explain_nodes, node, ctx.explain_nodes_cap, 64);
+
+	NodeStats* st = &ctx.explain_nodes[node];
+	*st = (NodeStats){ .parent = a->open };
+	a->open = node;
+
+	st->allocs = gmp_alloc_count();
+	st->bytes = ctx.arena.total;
+	st->ns = clock_ns();
+}
+
+static void analyze_leave(void* data, Value v) {
+	uint64_t now = clock_ns();
+	Analysis* a = data;
+
+	NodeStats* st = &ctx.explain_nodes[a->open];
+	st->ns = now - st->ns;
+	st->allocs = gmp_alloc_count() - st->allocs;
+	st->bytes = ctx.arena.total - st->bytes;
+	st->result = v;
+	a->open = st->parent;
+
+	if (st->parent >= 0) {
+		NodeStats* parent = &ctx.explain_nodes[st->parent];
+		parent->child_ns += st->ns;
+		parent->child_allocs += st->allocs;
+		parent->child_bytes += st->bytes;
 	}
+}
 
-	childproc_panic(RV_OTHER_ERROR,
-		"something bad happened on line %d", __LINE__);
+// type and size of a result as one word, like "integer:12limbs"
+static void write_value_size(dstr* out, Value v) {
+	if (v.type == V_LIST) {
+		dstr_printf(out, "list:%ditems", v.list_value.num_nums);
+		return;
+	}
+	if (v.type == V_RANGE) {
+		dstr_append(*out, "range");
+		return;
+	}
+
+	Number* n = &v.number_value;
+	if (n->type == NUM_INTEGER && n->is_small) {
+		dstr_append(*out, "integer:small");
+	} else if (n->type == NUM_INTEGER) {
+		dstr_printf(out, "integer:%zulimbs", mpz_size(n->integer_value));
+	} else if (n->type == NUM_RATIONAL) {
+		dstr_printf(out, "rational:%zu/%zulimbs",
+			mpz_size(mpq_numref(n->rational_value)),
+			mpz_size(mpq_denref(n->rational_value)));
+	} else {
+		dstr_printf(out, "real:%ldbits",
+			(long)mpfr_get_prec(n->real_value));
+	}
+}
+
+// deeper nodes are not indented further in the tree, and share one "..."
+// frame in the folded stacks, either would grow with the square of the
+// depth otherwise
+#define EXPLAIN_DEPTH_MAX 64
+
+// a node that explain() still has to print, and the length of the folded
+// stack of its parent
+typedef struct {
+	Expr* e;
+	int depth;
+	int stack_len;
+} ExplainFrame;
+
+void explain(char* prog, bool folded) {
+	Expr* root = parse_str(prog);
+	if (root == NULL) {
+		eval_panic(RV_PARSE_ERROR, "nothing to explain");
+	}
+
+	Analysis analysis = { .open = -1 };
+	EvalHooks hooks = { analyze_enter, analyze_leave, &analysis };
+	Value v = eval_hooked(root, &hooks);
+	NodeStats* stats = ctx.explain_nodes;
+
+	if (!folded) {
+		eval_return(v);
+		dstr_append(ctx.out, "= incl_us excl_us allocs excl_allocs "
+			"bytes excl_bytes result depth expr\n");
+	}
+
+	ExplainFrame* todo = NULL;
+	int todo_len = 0;
+	int todo_cap = 0;
+	arena_grow(todo, todo_len, todo_cap, 64);
+	todo[todo_len++] = (ExplainFrame){ root, 0, 0 };
+
+	// names of the calls from the root down to the current node,
+	// separated by ';' like stackcollapse does it
+	dstr stack = dstr_new();
+	dstr label = dstr_new();
+
+	for (int node = 0; todo_len > 0; node++) {
+		ExplainFrame f = todo[--todo_len];
+		NodeStats* st = &stats[node];
+
+		dstr_clear(label);
+		if (f.e->type == E_FUNCCALL) {
+			E_FuncData* fd = funccall_data(f.e);
+			dstr_append_len(label, fd->name, fd->name_len);
+		} else if (f.e->type == E_NUMBER) {
+			// one frame for all of them, their digits would only make the
+			// graph wider
+			dstr_append(label, folded ? "num" : "");
+			if (!folded) {
+				num_write(&label, f.e->number);
+			}
+		} else {
+			dstr_append_len(label, f.e->ident.name, f.e->ident.len);
+		}
+
+		if (folded) {
+			stack.len = f.stack_len;
+			if (f.depth <= EXPLAIN_DEPTH_MAX && stack.len > 0) {
+				dstr_append_char(stack, ';');
+			}
+			if (f.depth < EXPLAIN_DEPTH_MAX) {
+				dstr_append_len(stack, label.data, label.len);
+			} else if (f.depth == EXPLAIN_DEPTH_MAX) {
+				dstr_append(stack, "...");
+			}
+			dstr_printf(&ctx.out, "%s %llu\n", stack.data,
+				(unsigned long long)(st->ns - st->child_ns));
+		} else {
+			dstr_printf(&ctx.out, "= %.1f %.1f %zu %zu %zu %zu ",
+				st->ns / 1e3,
+				(st->ns - st->child_ns) / 1e3,
+				st->allocs,
+				st->allocs - st->child_allocs,
+				st->bytes,
+				st->bytes - st->child_bytes);
+			write_value_size(&ctx.out, st->result);
+			dstr_printf(&ctx.out, " %d ", f.depth);
+			for (int i = 0; i < min(f.depth, EXPLAIN_DEPTH_MAX); i++) {
+				dstr_append(ctx.out, "  ");
+			}
+			if (f.e->type == E_FUNCCALL) {
+				dstr_append_char(ctx.out, '(');
+			}
+			dstr_append_len(ctx.out, label.data, label.len);
+			dstr_append_char(ctx.out, '\n');
+		}
+
+		if (ctx.out.len >= OUT_FLUSH_SIZE) {
+			out_flush();
+		}
+
+		// backwards, so the first argument is the next node in pre-order
+		if (f.e->type == E_FUNCCALL) {
+			for (int i = f.e->funccall.num_args_passed - 1; i >= 0; i--) {
+				arena_grow(todo, todo_len, todo_cap, 64);
+				todo[todo_len++] = (ExplainFrame){
+					f.e->funccall.args[i],
+					f.depth + 1,
+					stack.len
+				};
+			}
+		}
+	}
+
+	dstr_free(stack);
+	dstr_free(label);
 }
 
 // char* stringify_value(Value v) {
@@ -458,42 +1238,183 @@ char* stringify_value_type(ValueType type) {
 	switch (type) {
 		case V_NUM: return "number";
 		case V_LIST: return "list of numbers";
+		case V_RANGE: return "range";
 		default: return "unknown";
 	}
 }
 
+// prints lists the way they are written, so the output can be pasted back
 void print_value(Value v) {
+	dstr* out = &ctx.out;
 	switch(v.type) {
-		case V_NUM: num_print(v.number_value); break;
-		// case V_LIST: numlist_print(v.list_value); break;
-		default: printf("(\?\?\?)");
+		case V_NUM: num_write(out, v.number_value); break;
+		case V_LIST:
+			dstr_append(*out, "(list");
+			for (int i = 0; i < v.list_value.num_nums; i++) {
+				dstr_append_char(*out, ' ');
+				num_write(out, nl_get(v.list_value, i));
+				if (out->len >= OUT_FLUSH_SIZE) {
+					out_flush();
+				}
+			}
+			dstr_append_char(*out, ')');
+			break;
+		case V_RANGE:
+			dstr_append(*out, "(range ");
+			num_write(out, v.range_value->start);
+			dstr_append_char(*out, ' ');
+			num_write(out, v.range_value->stop);
+			if (!v.range_value->step.is_small
+			|| v.range_value->step.small_value != 1) {
+				dstr_append_char(*out, ' ');
+				num_write(out, v.range_value->step);
+			}
+			dstr_append_char(*out, ')');
+			break;
+		default: dstr_append(*out, "(\?\?\?)");
+	}
+}
+
+void out_flush() {
+	fflush(stdout);
+
+	int done = 0;
+	while (done < ctx.out.len) {
+		ssize_t n = write(STDOUT_FILENO, ctx.out.data + done,
+			ctx.out.len - done);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			// nowhere to write to, drop it like a closed stdout would
+			break;
+		}
+		done += n;
+	}
+	dstr_clear(ctx.out);
+}
+
+void nl_reserve(NumberList* nl, int n) {
+	if (n <= nl->cap) {
+		return;
+	}
+
+	size_t elem = nl->unpacked ? sizeof(Number) : sizeof(int64_t);
+	nl->ints = arena_realloc(&ctx.arena, nl->ints,
+		elem * nl->cap, elem * n);
+	nl->cap = n;
+}
+
+// switches nl to the generic layout, keeping the capacity
+static void nl_unpack(NumberList* nl) {
+	Number* nums = arena_alloc(&ctx.arena, sizeof(Number) * max(nl->cap, 1));
+	for (int i = 0; i < nl->num_nums; i++) {
+		nums[i] = nl_get(*nl, i);
+	}
+	nl->nums = nums;
+	nl->unpacked = true;
+	nl->cap = max(nl->cap, 1);
+}
+
+void nl_append(NumberList* nl, Number n) {
+	if (!nl->unpacked) {
+		if (nl->num_nums == 0) {
+			nl->base = n.base;
+		}
+
+		if (n.is_small && n.base == nl->base) {
+			arena_grow(nl->ints, nl->num_nums, nl->cap, 16);
+			nl->ints[nl->num_nums++] = n.small_value;
+			return;
+		}
+
+		nl_unpack(nl);
+	}
+
+	arena_grow(nl->nums, nl->num_nums, nl->cap, 16);
+	nl->nums[nl->num_nums++] = n;
+}
+
+ListIter list_iter_new(Value list) {
+	ListIter it = { .list = list };
+	if (list.type == V_RANGE) {
+		it.cur = num_small(0);
+		num_set(&it.cur, &list.range_value->start);
+	}
+	return it;
+}
+
+bool list_iter_next(ListIter* it, Number* out) {
+	if (it->list.type == V_LIST) {
+		if (it->i >= it->list.list_value.num_nums) {
+			return false;
+		}
+		*out = nl_get(it->list.list_value, it->i);
+		it->i++;
+		return true;
+	}
+
+	NumberRange* r = it->list.range_value;
+
+	// past stop in the direction of step
+	int c = num_integer_cmp(&it->cur, &r->stop);
+	if (c == 0 || c == num_integer_sgn(&r->step)) {
+		return false;
+	}
+
+	// out keeps the old value, cur moves on without touching its limbs
+	*out = it->cur;
+	if (!it->cur.is_small) {
+		it->cur = num_small(0);
+		num_set(&it->cur, out);
 	}
+	num_add_into(&it->cur, &r->step);
+	return true;
 }
 
 void rt_init() {
 
+	// before anything allocates limbs
+	gmp_hooks_install();
+
+	simd_init();
+
+	// PNC_THREADS=n in the environment, one per cpu otherwise
+	char* threads = getenv("PNC_THREADS");
+	if (threads != NULL && atoi(threads) > 0) {
+		pool_init(atoi(threads));
+	} else {
+		pool_init(sysconf(_SC_NPROCESSORS_ONLN));
+	}
+
 	RT_CONSTANT_VARS = rt_varlist_new();
 
-	// broken
+	rt_add_constant("#false", (Value){
+		.type = V_NUM,
+		.number_value = num_small(0)
+	});
 
-	// rt_add_constant("#false", (Value){
-	// 	.type=V_NUM,
-	// 	.number_value=number_integer_from_u32(0)
-	// });
- //
-	// rt_add_constant("#true", (Value){
-	// 	.type=V_NUM,
-	// 	.number_value=number_integer_from_u32(1)
-	// });
+	rt_add_constant("#true", (Value){
+		.type = V_NUM,
+		.number_value = num_small(1)
+	});
 
-	// rt_add_constant("#pi", (Value){
-	// 	.type=V_NUM,
-	// 	.number_value=num_from_u32(3.1415926536)
-	// });
+	rt_add_computed_constant("#pi", const_pi);
+	rt_add_computed_constant("#e", const_e);
 
 	RT_BUILTIN_FUNCTIONS = rt_fnlist_new();
 
 	rt_add_func("+", e_func_add, 2, V_NUM, {V_NUM, V_NUM});
+	rt_add_func("list", e_func_list, RTFN_VARARGS, V_LIST, {V_NUM});
+	rt_add_func("len", e_func_len, 1, V_NUM, {V_LIST});
+	rt_add_func("sum", e_func_sum, 1, V_NUM, {V_LIST});
+	rt_add_func("prod", e_func_prod, 1, V_NUM, {V_LIST});
+	rt_add_func("range", e_func_range, RTFN_VARARGS, V_LIST, {V_NUM});
+	rt_add_func("fib", e_func_fib, 1, V_NUM, {V_NUM});
+	rt_add_func("min", e_func_min, 1, V_NUM, {V_LIST});
+	rt_add_func("max", e_func_max, 1, V_NUM, {V_LIST});
+	rt_add_func("count", e_func_count, 2, V_NUM, {V_LIST, V_NUM});
+	rt_add_func("dot", e_func_dot, 2, V_NUM, {V_LIST, V_LIST});
 	// rt_add_func("-", e_func_sub, 2, V_NUM, {V_NUM, V_NUM});
 	// rt_add_func("*", e_func_mul, 2, V_NUM, {V_NUM, V_NUM});
 	// rt_add_func("/", e_func_div, 2, V_NUM, {V_NUM, V_NUM});
@@ -505,13 +1426,10 @@ void rt_init() {
 	// rt_add_func("<", e_func_lt, 2, V_NUM, {V_NUM, V_NUM});
 	// rt_add_func(">=", e_func_ge, 2, V_NUM, {V_NUM, V_NUM});
 	// rt_add_func("bool", e_func_bool, 1, V_NUM, {V_NUM});
-	// rt_add_func("fib", e_func_fib, 1, V_NUM, {V_NUM});
-	// rt_add_func("list", e_func_list, RTFN_VARARGS, V_LIST, {V_NUM});
-	// rt_add_func("len", e_func_len, 1, V_NUM, {V_LIST});
-	// rt_add_func("sum", e_func_sum, 1, V_NUM, {V_LIST});
-	// rt_add_func("range", e_func_range, 2, V_NUM, {V_NUM, V_NUM});
 	// rt_add_func("if", e_func_if, 3, V_NUM, {V_NUM, V_NUM, V_NUM});
 
+	rt_fnlist_build_index(&RT_BUILTIN_FUNCTIONS);
+
 	// not needed, print the result instead
 	CPRV_ERROR_NAMES[RV_OK] = "";
 
@@ -554,79 +1472,459 @@ void rt_init() {
 
 }
 
-void eval_pnc_expr(char* input, bool spawn_child_proc) {
+// :prec prints the precision of new reals in bits, :prec <bits> sets it
+static void directive_prec(char* args) {
+	if (*args == '\0') {
+		dstr_printf(&ctx.out, "= %ld\n", (long)mpfr_get_default_prec());
+		return;
+	}
 
-	if (spawn_child_proc) {
+	if (!rt_set_prec(args)) {
+		eval_panic(RV_VALUE_ERROR,
+			"precision has to be a number of bits from %ld to %ld",
+			(long)MPFR_PREC_MIN, PREC_MAX);
+	}
+}
 
-		int pid = fork();
-		if (pid > 0) {
+char* PHASE_NAMES[NUM_PHASES] = {
+	[PHASE_TOKENIZE] = "tokenize",
+	[PHASE_MAKE_AST] = "make_ast",
+	[PHASE_PARSE] = "parse",
+	[PHASE_COMPILE] = "compile",
+	[PHASE_EVAL] = "eval",
+	[PHASE_PRINT] = "print",
+	[PHASE_WRITE] = "write",
+	[PHASE_CLEANUP] = "cleanup",
+	[PHASE_TOTAL] = "total",
+};
+
+void timing_begin_enabled() {
+	PhaseTiming* t = &ctx.timing;
+	memset(t->ran, 0, sizeof(t->ran));
+	t->start = clock_ns();
+	t->last = t->start;
+	t->running = true;
+#ifdef PNC_DEBUG
+	t->current = PHASE_TOKENIZE;
+#else
+	t->current = PHASE_PARSE;
+#endif
+}
 
-			// parent waits for child to finish
+void timing_mark_enabled(Phase p) {
+	PhaseTiming* t = &ctx.timing;
+	if (!t->running) {
+		return;
+	}
 
-			wait(NULL);
-			return;
+	uint64_t now = clock_ns();
+	t->ns[p] = now - t->last;
+	t->ran[p] = true;
+	t->last = now;
+	t->current = p + 1;
+}
 
-		} else if (pid < 0) {
+void timing_end_enabled() {
+	PhaseTiming* t = &ctx.timing;
+	if (!t->running) {
+		return;
+	}
+	t->running = false;
+
+	t->ns[PHASE_TOTAL] = clock_ns() - t->start;
+	t->ran[PHASE_TOTAL] = true;
+
+	// the result is already out, this goes to stderr so stdout stays
+	// just results
+	char line[512];
+	int len = snprintf(line, sizeof(line), "timing:");
+	for (int p = 0; p < NUM_PHASES; p++) {
+		if (t->ran[p]) {
+			hist_add(&t->hists[p], t->ns[p]);
+			len += snprintf(line + len, sizeof(line) - len, " %s_us=%.1f",
+				PHASE_NAMES[p], t->ns[p] / 1e3);
+		}
+	}
+	fprintf(stderr, "%s\n", line);
+}
 
-			// fork error
+// :timing prints whether evaluations are timed, :timing on|off turns it
+// on or off
+static void directive_timing(char* args) {
+	int len = strcspn(args, " \t\r\n");
+
+	if (len == 0) {
+		dstr_printf(&ctx.out, "= %s\n", ctx.timing.enabled ? "on" : "off");
+	} else if (len == 2 && memcmp(args, "on", 2) == 0) {
+		ctx.timing.enabled = true;
+	} else if (len == 3 && memcmp(args, "off", 3) == 0) {
+		ctx.timing.enabled = false;
+	} else {
+		eval_panic(RV_VALUE_ERROR, "expected on or off, got '%.*s'",
+			len, args);
+	}
+}
 
-			fputs("= ", stdout);
-			fputs(CPRV_ERROR_NAMES[RV_MEMORY_ERROR], stdout);
-			fputs(": process creation failed, try again\n", stdout);
+// :stats prints the count, mean, percentiles and max of every phase over
+// all timed evaluations, :stats reset forgets them
+static void directive_stats(char* args) {
+	PhaseTiming* t = &ctx.timing;
+	int len = strcspn(args, " \t\r\n");
 
-			return;
+	if (len == 5 && memcmp(args, "reset", 5) == 0) {
+		memset(t->hists, 0, sizeof(t->hists));
+		return;
+	} else if (len != 0) {
+		eval_panic(RV_VALUE_ERROR, "expected nothing or reset, got '%.*s'",
+			len, args);
+	}
+
+	if (t->hists[PHASE_TOTAL].count == 0) {
+		dstr_printf(&ctx.out, "= nothing timed yet, see :timing\n");
+		return;
+	}
+
+	for (int p = 0; p < NUM_PHASES; p++) {
+		LatencyHist* h = &t->hists[p];
+		if (h->count == 0) {
+			continue;
 		}
+		dstr_printf(&ctx.out,
+			"= phase=%s count=%llu total_us=%.1f mean_us=%.1f p50_us=%.1f "
+			"p90_us=%.1f p99_us=%.1f max_us=%.1f\n",
+			PHASE_NAMES[p],
+			(unsigned long long)h->count,
+			h->sum / 1e3,
+			(double)h->sum / h->count / 1e3,
+			hist_percentile(h, 50) / 1e3,
+			hist_percentile(h, 90) / 1e3,
+			hist_percentile(h, 99) / 1e3,
+			h->max / 1e3);
+	}
+}
+
+static void print_mem_stats(char* name, MemStats* m) {
+	dstr_printf(&ctx.out,
+		"= mem=%s front_bytes=%zu arena_total=%zu arena_peak=%zu "
+		"gmp_total=%zu gmp_peak=%zu heap_peak=%zu\n",
+		name, m->front_bytes, m->arena_total, m->arena_peak,
+		m->gmp_total, m->gmp_peak, m->heap_peak);
+}
+
+// :mem prints the memory used by the last evaluation and the most used
+// by any, :mem limit <size> caps it (see rt_set_mem_limit())
+static void directive_mem(char* args) {
+	int len = strcspn(args, " \t\r\n");
+
+	if (len == 5 && memcmp(args, "limit", 5) == 0) {
+		char* size = args + len + strspn(args + len, " \t\r\n");
+		if (*size == '\0') {
+			dstr_printf(&ctx.out, "= %zu\n", ctx.mem_limit);
+		} else if (!rt_set_mem_limit(size)) {
+			eval_panic(RV_VALUE_ERROR,
+				"expected a number of bytes like 512m, got '%.*s'",
+				(int)strcspn(size, "\r\n"), size);
+		}
+		return;
+	} else if (len != 0) {
+		eval_panic(RV_VALUE_ERROR, "expected nothing or limit, got '%.*s'",
+			len, args);
+	}
+
+	print_mem_stats("last", &ctx.mem_last);
+	print_mem_stats("max", &ctx.mem_max);
+}
 
+// :explain <expr> evaluates expr and prints how long every node of it took,
+// :explain folded <expr> prints that as folded stacks for flame graphs
+static void directive_explain(char* args) {
+	int len = strcspn(args, " \t\r\n");
+	bool folded = (len == 6 && memcmp(args, "folded", 6) == 0);
+	if (folded) {
+		args += len + strspn(args + len, " \t\r\n");
 	}
+	explain(args, folded);
+}
 
-	// if fork was called, only the child got to this point
-	// if not, the main process is doing this stuff
+typedef struct {
+	char* name;
+	void (*run)(char* args);
+} ReplDirective;
+
+// lines that start with ':' control the repl instead of being evaluated
+static ReplDirective REPL_DIRECTIVES[] = {
+	{ ":prec", directive_prec },
+	{ ":timing", directive_timing },
+	{ ":stats", directive_stats },
+	{ ":mem", directive_mem },
+	{ ":explain", directive_explain },
+};
+
+// runs the directive in line, which starts with ':'
+static void repl_directive(char* line) {
+	int name_len = strcspn(line, " \t\r\n");
+
+	// the arguments without the whitespace in front, empty if there are
+	// none, the line may still end in whitespace
+	char* args = line + name_len;
+	args += strspn(args, " \t\r\n");
+
+	int num_directives = sizeof(REPL_DIRECTIVES) / sizeof(REPL_DIRECTIVES[0]);
+	for (int i = 0; i < num_directives; i++) {
+		ReplDirective* d = &REPL_DIRECTIVES[i];
+		if ((int)strlen(d->name) == name_len
+		&& memcmp(d->name, line, name_len) == 0) {
+			d->run(args);
+			return;
+		}
+	}
+
+	eval_panic(RV_NAME_ERROR, "unknown directive '%.*s'", name_len, line);
+}
+
+void eval_pnc_expr(char* input) {
 
 	if (input == NULL) {
 		return;
 	}
-	
+
+	ctx.gmp_stats = (GmpAllocStats){0};
+	ctx.gmp_use_arena = true;
+	atomic_store(&ctx.mem_heap_bytes, 0);
+	atomic_store(&ctx.mem_heap_peak, 0);
+	atomic_store(&ctx.mem_exceeded, false);
+
+	// memory kept from before counts against the limit too
+	ctx.arena.limit = ctx.mem_limit;
+	if (ctx.mem_limit != 0 && ctx.arena.chunk_bytes > ctx.mem_limit) {
+		arena_free(&ctx.arena);
+	}
+
+	// eval_panic() lands here with its error code, the message has
+	// already been printed so only the cleanup is left
+	if (setjmp(ctx.eval_env) != 0) {
+		timing_mark(ctx.timing.current);
+		eval_cleanup();
+		return;
+	}
+
+	char* line = input + strspn(input, " \t");
+	ctx.in_directive = (*line == ':');
+	if (ctx.in_directive) {
+		repl_directive(line);
+		eval_cleanup();
+		return;
+	}
+
+	ctx.mem_last.front_bytes = 0;
+
+	timing_begin();
+
+#ifdef PNC_DEBUG
+	// run the steps separately and show what each one produced
+
 	TokenList tl = tokenize(input);
+	timing_mark(PHASE_TOKENIZE);
+	tl_print(tl);
 
 	if (tl.len == 0) {
+		eval_cleanup();
 		return;
 	}
-	
+
 	ASTNode* ast = make_ast(tl);
+	timing_mark(PHASE_MAKE_AST);
 
 	if (ast == NULL) {
+		eval_cleanup();
 		return;
 	}
 
+	node_print(ast);
+
 	Expr* expr = parse(ast);
+#else
+	Expr* expr = parse_str(input);
+#endif
+	timing_mark(PHASE_PARSE);
+	ctx.mem_last.front_bytes = ctx.arena.total;
+
+	// huge literals
+	mem_check();
 
 	if (expr == NULL) {
+		eval_cleanup();
 		return;
 	}
 
-	Value v = eval(expr);
+#ifdef PNC_DEBUG
+	expr_print(expr);
+#endif
 
-	if (spawn_child_proc) {
-		// child exits, freeing all memory
-		childproc_return(v);
-	} else {
-		// or main process prints the result
+	Chunk chunk = compile(expr);
+	timing_mark(PHASE_COMPILE);
+
+#ifdef PNC_DEBUG
+	chunk_print(&chunk);
+#endif
+
+	Value v = vm_run(&chunk);
+	timing_mark(PHASE_EVAL);
+
+	// the result is there, printing it may not be cut short by the limit
+	ctx.arena.limit = 0;
+	eval_return(v);
+	timing_mark(PHASE_PRINT);
+	eval_cleanup();
+}
+
+void eval_cleanup() {
+	out_flush();
+	timing_mark(PHASE_WRITE);
+
+#ifdef PNC_DEBUG
+	printf("gmp: %zu allocs, %zu reallocs, %zu frees, %zu bytes, "
+		"%zu peak\n",
+		ctx.gmp_stats.allocs,
+		ctx.gmp_stats.reallocs,
+		ctx.gmp_stats.frees,
+		ctx.gmp_stats.bytes,
+		ctx.gmp_stats.peak);
+#endif
+
+	// front_bytes was set after parsing, and stays 0 if it failed
+	if (!ctx.in_directive) {
+		MemStats* m = &ctx.mem_last;
+		m->arena_total = ctx.arena.total;
+		m->arena_peak = ctx.arena.peak;
+		m->gmp_total = ctx.gmp_stats.bytes;
+		m->gmp_peak = ctx.gmp_stats.peak;
+		m->heap_peak = atomic_load(&ctx.mem_heap_peak);
+
+		MemStats* mx = &ctx.mem_max;
+		mx->front_bytes = max(mx->front_bytes, m->front_bytes);
+		mx->arena_total = max(mx->arena_total, m->arena_total);
+		mx->arena_peak = max(mx->arena_peak, m->arena_peak);
+		mx->gmp_total = max(mx->gmp_total, m->gmp_total);
+		mx->gmp_peak = max(mx->gmp_peak, m->gmp_peak);
+		mx->heap_peak = max(mx->heap_peak, m->heap_peak);
+	}
+
+	// mpfr keeps constants and a pool of mpz temporaries between calls,
+	// they may point into the arena
+	mpfr_free_cache();
+
+	ctx.gmp_use_arena = false;
+	arena_reset(&ctx.arena);
+
+	// only evaluations are limited, see eval_pnc_expr()
+	ctx.arena.limit = 0;
+	atomic_store(&ctx.mem_exceeded, false);
+	timing_mark(PHASE_CLEANUP);
+	timing_end();
+}
 
-		fputs("= ", stdout);
-		print_value(v);
-		fputc('\n', stdout);
+_Thread_local bool gmp_heap_only;
+
+// added bytes of limbs that are alive now, removed ones that are not
+// limbs from before the evaluation can be freed during it, so live
+// stops at 0
+#define gmp_count_live(added, removed) \
+	do { \
+		GmpAllocStats* s = &ctx.gmp_stats; \
+		s->live = (s->live + (added) > (removed)) \
+			? s->live + (added) - (removed) \
+			: 0; \
+		s->peak = max(s->peak, s->live); \
+	} while(0)
+
+// past the limit the arena hands out the memory anyway, gmp cannot
+// handle an allocation that fails or does not return, see mem_check()
+// returns the limit to put back afterwards
+static size_t gmp_lift_limit(size_t size) {
+	size_t limit = ctx.arena.limit;
+	if (!mem_fits(size)) {
+		atomic_store(&ctx.mem_exceeded, true);
+		ctx.arena.limit = 0;
+	}
+	return limit;
+}
+
+static void* gmp_alloc(size_t size) {
+	if (!gmp_heap_only) {
+		ctx.gmp_stats.allocs++;
+		ctx.gmp_stats.bytes += size;
+		gmp_count_live(size, 0);
+
+		if (ctx.gmp_use_arena) {
+			size_t limit = gmp_lift_limit(size);
+			void* p = arena_alloc(&ctx.arena, size);
+			ctx.arena.limit = limit;
+			return p;
+		}
+	}
+
+	void* p = malloc(size);
+	if (p == NULL) {
+		fputs("fatal: out of memory\n", stderr);
+		abort();
+	}
+	mem_count_heap(size, 0);
+	return p;
+}
+
+static void* gmp_realloc(void* ptr, size_t old_size, size_t new_size) {
+	// limbs stay where they were allocated, a number made by rt_init()
+	// keeps its heap memory even if it grows during an evaluation
+	if (!gmp_heap_only) {
+		ctx.gmp_stats.reallocs++;
+		if (new_size > old_size) {
+			ctx.gmp_stats.bytes += new_size - old_size;
+		}
+		gmp_count_live(new_size, old_size);
+
+		if (arena_owns(&ctx.arena, ptr)) {
+			size_t limit = gmp_lift_limit(new_size);
+			void* p = arena_realloc(&ctx.arena, ptr, old_size, new_size);
+			ctx.arena.limit = limit;
+			return p;
+		}
+	}
 
-		// free(str);
+	void* p = realloc(ptr, new_size);
+	if (p == NULL) {
+		fputs("fatal: out of memory\n", stderr);
+		abort();
 	}
+	mem_count_heap(new_size, old_size);
+	return p;
+}
+
+static void gmp_free(void* ptr, size_t size) {
+	// gmp frees its own temporaries right away, mostly in lifo order
+	if (!gmp_heap_only) {
+		ctx.gmp_stats.frees++;
+		gmp_count_live(0, size);
+
+		if (arena_owns(&ctx.arena, ptr)) {
+			arena_pop(&ctx.arena, ptr);
+			return;
+		}
+	}
+
+	free(ptr);
+	mem_count_heap(0, size);
+}
+
+void gmp_hooks_install() {
+	mp_set_memory_functions(gmp_alloc, gmp_realloc, gmp_free);
 }
 
 void repl_once(char* prog) {
 
 	// read program from input string
 	if (prog != NULL) {
-
-		// do not spawn child process, only run it once
-		eval_pnc_expr(prog, false);
+		eval_pnc_expr(prog);
 	}
 	
 	// or read from stdin
@@ -635,22 +1933,37 @@ void repl_once(char* prog) {
 		char* buffer = NULL;
 		size_t size = 0;
 
-		getline(&buffer, &size, stdin);
-		if (buffer == NULL || size == 0) {
-			// empty line
+		if (getline(&buffer, &size, stdin) < 0) {
+			// end of input
+			free(buffer);
+			ctx.is_running = false;
 			return;
 		}
 
-		// spawn child proc, compute result, and kill it
-		// the child proc will print the result
-		eval_pnc_expr(buffer, true);
+		eval_pnc_expr(buffer);
 		free(buffer);
 	}
 }
 
 // main process exit
 void repl_quit() {
+	// needs the names of the builtins
+	profile_free();
+
 	free(RT_CONSTANT_VARS.vars);
+	for (int i = 0; i < RT_BUILTIN_FUNCTIONS.num_fns; i++) {
+		free(RT_BUILTIN_FUNCTIONS.fns[i].arg_types);
+	}
 	free(RT_BUILTIN_FUNCTIONS.fns);
-	exit(RV_OK);
+	free(RT_BUILTIN_FUNCTIONS.index);
+	free(ctx.vm_stack);
+	free(ctx.eval_frames);
+	free(ctx.eval_stack);
+	free(ctx.explain_nodes);
+	dstr_free(ctx.out);
+	fib_memo_clear();
+	rt_constant_cache_clear();
+	pool_free();
+	arena_free(&ctx.arena);
+	exit(EXIT_SUCCESS);
 }
@@ -3,17 +3,49 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <math.h>
+#include <setjmp.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
+#include "arena.h"
 #include "number.h"
+#include "pool.h"
+#include "simd.h"
+#include "stats.h"
+
+// makes room for one more item in an array that lives in the evaluation
+// arena, the capacity doubles like in tl_resize
+#define arena_grow(arr, len, cap, min_cap) \
+	do { \
+		if ((len) == (cap)) { \
+			int new_cap = max((min_cap), 2 * (cap)); \
+			(arr) = arena_realloc(&ctx.arena, (arr), \
+				sizeof(*(arr)) * (cap), sizeof(*(arr)) * new_cap); \
+			(cap) = new_cap; \
+		} \
+	} while(0)
+
+// same for arrays on the heap that outlive an evaluation
+#define heap_grow(arr, len, cap, min_cap) \
+	do { \
+		if ((len) >= (cap)) { \
+			int new_cap = max(max((min_cap), (len) + 1), 2 * (cap)); \
+			void* new_arr = realloc((arr), sizeof(*(arr)) * new_cap); \
+			if (new_arr == NULL) { \
+				eval_panic(RV_MEMORY_ERROR, \
+					"memory allocation failed, try again"); \
+			} \
+			(arr) = new_arr; \
+			(cap) = new_cap; \
+		} \
+	} while(0)
 
 // token
 
@@ -29,6 +61,9 @@ typedef struct {
 	
 	char* atom_str;
 	int atom_len;
+
+	// position in the input string, used in error messages
+	int offset;
 } Token;
 
 #define token_fmt \
@@ -51,15 +86,22 @@ typedef struct {
 typedef struct {
 	Token* tokens;
 	int len;
+	int cap;
 } TokenList;
 
 #define tl_new() \
 	((TokenList){0})
 
+// capacity doubles, memory comes from the evaluation arena
 #define tl_resize(tl, n) \
 	do { \
+		if ((n) > (tl).cap) { \
+			int new_cap = max((n), 2 * (tl).cap); \
+			(tl).tokens = arena_realloc(&ctx.arena, (tl).tokens, \
+				sizeof(Token) * (tl).cap, sizeof(Token) * new_cap); \
+			(tl).cap = new_cap; \
+		} \
 		(tl).len = (n); \
-		(tl).tokens = realloc((tl).tokens, sizeof(Token) * (tl).len); \
 	} while(0)
 
 #define tl_append(tl, ... ) \
@@ -78,6 +120,24 @@ typedef struct {
 // step 1: string to list of tokens 
 TokenList tokenize(char* prog);
 
+// lexer - hands out one token at a time instead of building a TokenList
+
+typedef struct {
+	char* prog;
+	int pos;
+
+	// set by lex_peek(), returned by the next lex_next()
+	Token peeked;
+	bool has_peeked;
+} Lexer;
+
+#define lexer_new(prog_str) \
+	((Lexer){ .prog = (prog_str) })
+
+// returns a T_NONE token at the end of the input
+Token lex_next(Lexer* lx);
+Token lex_peek(Lexer* lx);
+
 // ast
 
 typedef enum {
@@ -92,13 +152,15 @@ typedef struct ASTNode {
 		// A_ATOM
 		struct { char* atom_str; int atom_len; };
 		// A_LIST
-		struct { struct ASTNode** list_items; int list_len; };
+		struct { struct ASTNode** list_items; int list_len; int list_cap; };
 	};
 } ASTNode;
 
 #define node_new() \
-	(calloc(1, sizeof(ASTNode)))
+	(arena_calloc(&ctx.arena, 1, sizeof(ASTNode)))
 
+// prints node and its children, indented by level
+// walks the tree with an explicit stack, so any depth works
 void node_print_rec(ASTNode* node, int level);
 
 #define node_print(node) \
@@ -106,8 +168,15 @@ void node_print_rec(ASTNode* node, int level);
 
 #define list_resize(node, n) \
 	do { \
+		if ((n) > (node)->list_cap) { \
+			int new_cap = max((n), 2 * (node)->list_cap); \
+			(node)->list_items = arena_realloc(&ctx.arena, \
+				(node)->list_items, \
+				sizeof(ASTNode*) * (node)->list_cap, \
+				sizeof(ASTNode*) * new_cap); \
+			(node)->list_cap = new_cap; \
+		} \
 		(node)->list_len = (n); \
-		(node)->list_items = realloc((node)->list_items, sizeof(ASTNode*) * (node)->list_len); \
 	} while(0)
 
 // arg must be a ASTNode*
@@ -121,6 +190,7 @@ void node_print_rec(ASTNode* node, int level);
 ASTNode* make_ast_single(Token t);
 
 // assumes OPEN_PAREN, ..., CLOSE_PAREN
+// builds the whole tree in one pass over tl using a stack of open lists
 ASTNode* make_ast_list_simple(TokenList tl);
 
 // step 2: list of tokens to ast tree
@@ -141,40 +211,91 @@ typedef struct {
 typedef enum {
 	V_NONE = 0, // an empty program produces this value
 	V_NUM,
-	V_LIST // list of numbers, NOT VALUES TODO fix this
+	V_LIST, // list of numbers, NOT VALUES TODO fix this
+	V_RANGE // lazy list of integers, accepted anywhere a V_LIST is
 } ValueType;
 
 struct Value;
 
+// list of numbers in ctx.arena, grows geometrically
+// as long as every number is a small integer with the same base, the list
+// is packed: ints holds plain int64_t values (8 bytes per number instead
+// of a whole Number), the first other number unpacks it into nums
 typedef struct {
-	Number* nums;
+	bool unpacked;
+
+	// base of every number in a packed list
+	uint8_t base;
+
+	union {
+		int64_t* ints; // packed
+		Number* nums; // unpacked
+	};
 	int num_nums;
+	int cap;
 } NumberList;
 
+// a new list is empty and packed
 #define nl_new() \
 	((NumberList){0})
 
-#define nl_resize(nl, n) \
-	do { \
-		(nl).num_nums = (n); \
-		(nl).nums = realloc((nl).nums, sizeof(Number) * (nl).num_nums); \
-	} while(0)
+// makes room for n numbers in total
+void nl_reserve(NumberList* nl, int n);
 
-#define nl_append(nl, ... ) \
-	do { \
-		nl_resize((nl), (nl).num_nums + 1); \
-		(nl).nums[(nl).num_nums - 1] = (__VA_ARGS__); \
-	} while(0)
+// amortized O(1)
+void nl_append(NumberList* nl, Number n);
+
+// the number at index i, which must be in range
+#define nl_get(nl, i) \
+	((nl).unpacked \
+		? (nl).nums[(i)] \
+		: (Number){ .type = NUM_INTEGER, .base = (nl).base, \
+			.is_small = true, .small_value = (nl).ints[(i)] })
+
+// the integers start, start + step, ... up to but not including stop
+// nothing is materialized, so (range 0 100000000) costs the same as
+// (range 0 10), len and sum use closed forms
+typedef struct {
+	Number start;
+	Number stop;
+	Number step; // never 0
+} NumberRange;
 
 typedef struct Value {
 	ValueType type;
 	union {
 		Number number_value;
 		NumberList list_value;
+		NumberRange* range_value; // in ctx.arena
 	};
 } Value;
 
-typedef Value E_Func(struct Expr*);
+// true for every type that can be iterated with list_iter_next()
+#define value_is_list(v) \
+	((v).type == V_LIST || (v).type == V_RANGE)
+
+// walks over the numbers of a list or a range
+// a range allocates nothing unless its numbers do not fit in an int64_t
+typedef struct {
+	Value list;
+
+	// V_LIST: index of the next number
+	int i;
+
+	// V_RANGE: the next number
+	Number cur;
+} ListIter;
+
+ListIter list_iter_new(Value list);
+
+// writes the next number to out and returns true, or returns false at the
+// end of the list
+// out is only valid until the next call
+bool list_iter_next(ListIter* it, Number* out);
+
+// builtins get their arguments already evaluated and type checked against
+// E_FuncData.arg_types, by eval() or by the vm
+typedef Value E_Func(Value* args, int num_args);
 
 // pass this to rt_func() to signify that the function takes a variable #
 // of arguments
@@ -198,40 +319,59 @@ typedef struct {
 } E_FuncData;
 
 typedef struct {
-	E_FuncData func;
+	// index into RT_BUILTIN_FUNCTIONS.fns
+	int func_index;
 	struct Expr** args;
 	int num_args_passed;
 } E_FuncCall;
 
+// E_FuncData* of the function a E_FUNCCALL expr calls
+#define funccall_data(e) \
+	(&RT_BUILTIN_FUNCTIONS.fns[(e)->funccall.func_index])
+
 // declarations of builtin functions and operators
-Value e_func_add(struct Expr* e);
-// Value e_func_sub(struct Expr* e);
-// Value e_func_mul(struct Expr* e);
-// Value e_func_div(struct Expr* e);
-// Value e_func_mod(struct Expr* e);
-//
-// Value e_func_eq(struct Expr* e);
-// Value e_func_neq(struct Expr* e);
-// Value e_func_lt(struct Expr* e);
-// Value e_func_gt(struct Expr* e);
-// Value e_func_le(struct Expr* e);
-// Value e_func_ge(struct Expr* e);
+Value e_func_add(Value* args, int num_args);
+// Value e_func_sub(Value* args, int num_args);
+// Value e_func_mul(Value* args, int num_args);
+// Value e_func_div(Value* args, int num_args);
+// Value e_func_mod(Value* args, int num_args);
 //
-// Value e_func_bool(struct Expr* e);
+// Value e_func_eq(Value* args, int num_args);
+// Value e_func_neq(Value* args, int num_args);
+// Value e_func_lt(Value* args, int num_args);
+// Value e_func_gt(Value* args, int num_args);
+// Value e_func_le(Value* args, int num_args);
+// Value e_func_ge(Value* args, int num_args);
 //
-// Value e_func_fib(struct Expr* e);
+// Value e_func_bool(Value* args, int num_args);
 //
-// Value e_func_list(struct Expr* e);
-// Value e_func_len(struct Expr* e);
-// Value e_func_sum(struct Expr* e);
-// Value e_func_range(struct Expr* e);
+Value e_func_fib(Value* args, int num_args);
+
+// frees the results fib() keeps around between evaluations
+void fib_memo_clear();
+
+Value e_func_list(Value* args, int num_args);
+Value e_func_len(Value* args, int num_args);
+Value e_func_sum(Value* args, int num_args);
+Value e_func_prod(Value* args, int num_args);
+Value e_func_range(Value* args, int num_args);
+Value e_func_min(Value* args, int num_args);
+Value e_func_max(Value* args, int num_args);
+Value e_func_count(Value* args, int num_args);
+Value e_func_dot(Value* args, int num_args);
 //
-// Value e_func_if(struct Expr* e);
+// Value e_func_if(Value* args, int num_args);
 
 // list of functions defined in the runtime
 typedef struct {
 	E_FuncData* fns;
 	int num_fns;
+
+	// open addressing hash table of indices into fns, keyed on the exact
+	// name, -1 means an empty slot
+	// built by rt_fnlist_build_index() once every function is added
+	int* index;
+	int index_cap; // always a power of 2
 } RT_FnList;
 
 #define rt_fnlist_new() \
@@ -266,6 +406,9 @@ typedef struct {
 // their argument count, argument types, return types are all specified in here
 extern RT_FnList RT_BUILTIN_FUNCTIONS;
 
+// (re)builds the name lookup table of l
+void rt_fnlist_build_index(RT_FnList* l);
+
 typedef enum {
 	E_NONE,
 	E_NUMBER,
@@ -283,7 +426,7 @@ typedef struct Expr {
 } Expr;
 
 #define expr_new() \
-	(calloc(1, sizeof(Expr)))
+	(arena_calloc(&ctx.arena, 1, sizeof(Expr)))
 
 #define expr_print(e) \
 	do { \
@@ -293,12 +436,53 @@ typedef struct Expr {
 
 void expr_print_rec(Expr* e);
 
+// appends e in the form it was written in, without comments and with
+// single spaces
+void expr_write(dstr* out, Expr* e);
+
 // step 3: ast tree to expr tree
 Expr* parse(ASTNode* ast);
 
+// steps 1-3 in one pass: string straight to expr tree, pulling tokens from a
+// Lexer without building a TokenList or an ast
+// returns NULL if the input is empty
+// steps 1-3 are still used instead when built with -DPNC_DEBUG, so the
+// intermediate results can be printed
+Expr* parse_str(char* prog);
+
+// turns a single atom into a number or an identifier
+Expr* parse_atom(char* atom_str, int atom_len);
+
+// finds a builtin function by its exact name in O(1)
+// returns its index in RT_BUILTIN_FUNCTIONS.fns or -1 if there is none
+int rt_find_func(char* name, int name_len);
+
 // step 4: collapse expr tree to get a single value
+// tree walker, the repl uses compile() and vm_run() instead
+// keeps its own stack on the heap, so nesting depth is only limited by memory
 Value eval(Expr* e);
 
+// called by eval_hooked() for every node of the expr tree, enter before
+// the node is evaluated and leave with its value, enter comes in
+// pre-order and every leave belongs to the last node entered that has not
+// been left yet
+typedef struct {
+	void (*enter)(void* data, Expr* e);
+	void (*leave)(void* data, Value v);
+	void* data;
+} EvalHooks;
+
+// eval() with hooks, explain() measures the nodes with them
+Value eval_hooked(Expr* e, EvalHooks* hooks);
+
+// EXPLAIN ANALYZE for expressions: evaluates prog like eval() and appends
+// the result and a line per node of the expr tree to ctx.out, with its
+// inclusive and exclusive time, gmp allocations and arena bytes and the
+// type and size of its result
+// folded prints one "caller;callee exclusive_ns" line per node instead,
+// the input flamegraph.pl expects
+void explain(char* prog, bool folded);
+
 // ast_matches_*** should not write to out unless it will also return true
 
 // contains number parsing code
@@ -306,26 +490,42 @@ bool ast_matches_intlit(ASTNode* ast, int* out);
 bool ast_matches_ident(ASTNode* ast, E_Ident* out);
 
 // uses RT_BUILTIN_FUNCTIONS
+// only the function and the space for the arguments are filled in,
+// parse() fills in the arguments themselves
 bool ast_matches_funccall(ASTNode* ast, E_FuncCall* out);
 
-// allocates data (can be freed on childproc exit like everything else)
+// allocates data (the caller frees it)
 char* stringify_value(Value v);
 
 // returns a static string literal
 char* stringify_value_type(ValueType type);
 
+// prints v to ctx.out
+// a long list is written out in parts along the way, so ctx.out does not
+// grow much past OUT_FLUSH_SIZE
 void print_value(Value v);
 
-// called outside of each e_func_***
+#define OUT_FLUSH_SIZE (1 << 16)
+
+// writes ctx.out to stdout with one write() and empties it
+// whatever went to stdout through stdio comes out first
+void out_flush();
+
+// called before each e_func_***
 void assert_funccall_arg_count_correct(Expr* e);
 
-// called inside each e_func_***, once per argument
-Value try_eval_arg_as_type(Expr* e, int arg_num, ValueType type);
+// called before each e_func_***, once per argument
+void assert_arg_type_correct(E_FuncData* fd, int arg_num, Value v);
 
 // another associative type
 typedef struct {
 	char* name;
 	Value value;
+
+	// for reals like #pi that depend on the precision: writes the constant
+	// to out at the precision of out, value is unused then
+	// see rt_constant_value()
+	void (*compute)(mpfr_ptr out);
 } VarData;
 
 typedef struct {
@@ -367,6 +567,62 @@ extern RT_VarList RT_CONSTANT_VARS;
 // a name that starts with '#'
 Value eval_constant(Expr* e);
 
+// index of the constant in RT_CONSTANT_VARS.vars or -1 if there is none
+int rt_find_constant(char* name, int name_len);
+
+// value of RT_CONSTANT_VARS.vars[i] at the current precision
+// computed constants are cached per precision and outlive evaluations,
+// so using #pi over and over computes it once
+Value rt_constant_value(int i);
+
+// frees the cached values of the computed constants
+void rt_constant_cache_clear();
+
+// bytecode
+// an Expr tree compiles to a flat list of instructions for a stack machine,
+// every instruction is an opcode followed by its operands
+
+typedef enum {
+	// push Chunk.nums[operand]
+	OP_PUSH_NUM,
+
+	// push RT_CONSTANT_VARS.vars[operand].value
+	OP_PUSH_CONST,
+
+	// pop <operand 2> arguments, call RT_BUILTIN_FUNCTIONS.fns[operand 1]
+	// and push the result
+	OP_CALL,
+} OpCode;
+
+// number of operands that follow each opcode
+#define op_num_operands(op) \
+	((op) == OP_CALL ? 2 : 1)
+
+typedef struct {
+	int32_t* code;
+	int code_len;
+	int code_cap;
+
+	// number literals
+	Number* nums;
+	int num_nums;
+	int nums_cap;
+
+	// the vm needs this many stack slots at most
+	int max_stack;
+} Chunk;
+
+// lowers e into bytecode, memory comes from the evaluation arena
+// name and argument count errors are reported here instead of at runtime
+// a chunk can be run any number of times
+Chunk compile(Expr* e);
+
+// runs c on ctx.vm_stack and returns the value left on top
+Value vm_run(Chunk* c);
+
+// prints one instruction per line
+void chunk_print(Chunk* c);
+
 // runtime stuff
 
 // initialize starting constants and builtin functions
@@ -378,6 +634,73 @@ void rt_init();
 		.value=(__VA_ARGS__) \
 	})
 
+// a real constant that compute_fn writes at the current precision
+#define rt_add_computed_constant(name_cstrlit, compute_fn) \
+	rt_varlist_append(RT_CONSTANT_VARS, (VarData){ \
+		.name=(name_cstrlit), \
+		.compute=(compute_fn) \
+	})
+
+// highest precision --prec and :prec accept, in bits
+#define PREC_MAX (1L << 26)
+
+// sets the precision of new reals from a number of bits in a string,
+// false if it is not a number between MPFR_PREC_MIN and PREC_MAX
+bool rt_set_prec(char* bits);
+
+// caps the memory of an evaluation, a number of bytes with an optional
+// k, m or g suffix, 0 for no cap
+// an evaluation that needs more stops with RV_MEMORY_ERROR
+// false if the string is not a size
+bool rt_set_mem_limit(char* size);
+
+// true if size more bytes fit under the memory limit of the evaluation,
+// the arena chunks and the limbs on the heap together
+bool mem_fits(size_t size);
+
+// stops the evaluation with RV_MEMORY_ERROR
+void mem_limit_panic();
+
+// true if size more bytes on the heap fit under the limit, from any thread
+#define mem_heap_fits(size) \
+	(ctx.arena.limit == 0 \
+		|| ctx.arena.chunk_bytes + (size) \
+			+ (size_t)max(atomic_load_explicit(&ctx.mem_heap_bytes, \
+				memory_order_relaxed), 0) \
+			<= ctx.arena.limit)
+
+// counts heap memory against the limit of the evaluation, from any thread
+// going over it sets ctx.mem_exceeded
+#define mem_count_heap(added, removed) \
+	do { \
+		if (ctx.arena.limit != 0) { \
+			int64_t delta = (int64_t)(added) - (int64_t)(removed); \
+			int64_t heap = atomic_fetch_add_explicit(&ctx.mem_heap_bytes, \
+				delta, memory_order_relaxed) + delta; \
+			int64_t peak = atomic_load_explicit(&ctx.mem_heap_peak, \
+				memory_order_relaxed); \
+			while (heap > peak && !atomic_compare_exchange_weak_explicit( \
+			&ctx.mem_heap_peak, &peak, heap, memory_order_relaxed, \
+			memory_order_relaxed)) { \
+			} \
+			if (delta > 0 && ctx.arena.chunk_bytes + (size_t)max(heap, 0) \
+			> ctx.arena.limit) { \
+				atomic_store(&ctx.mem_exceeded, true); \
+			} \
+		} \
+	} while(0)
+
+// gmp must not be unwound from the middle of a call, so its allocations
+// past the limit still succeed and only set ctx.mem_exceeded
+// this stops the evaluation once gmp has returned, after every builtin
+#define mem_check() \
+	do { \
+		if (__builtin_expect(atomic_load_explicit(&ctx.mem_exceeded, \
+		memory_order_relaxed), 0)) { \
+			mem_limit_panic(); \
+		} \
+	} while(0)
+
 // declare a runtime function (without having to specify name len separately)
 // the ... is the list of return types so you can pass like {V_INT, V_LIST, V_INT, ...}
 // for varargs all of the varargs will be evaluated as the last type in the list
@@ -385,18 +708,182 @@ void rt_init();
 // which can be 0
 #define rt_add_func(name_cstrlit, actual_func_ptr, \
 func_arg_count, func_ret_type, ...) \
-	rt_fnlist_append(RT_BUILTIN_FUNCTIONS, (E_FuncData){ \
-		.name = (name_cstrlit), \
-		.name_len = strlen(name_cstrlit), \
-		.num_args = (func_arg_count), \
-		.arg_types = ((ValueType[]) __VA_ARGS__), \
-		.return_type = (func_ret_type), \
-		.actual_function = (actual_func_ptr) \
-	})
+	do { \
+		/* copied, a compound literal would not outlive rt_init() */ \
+		ValueType arg_types[] = __VA_ARGS__; \
+		rt_fnlist_append(RT_BUILTIN_FUNCTIONS, (E_FuncData){ \
+			.name = (name_cstrlit), \
+			.name_len = strlen(name_cstrlit), \
+			.num_args = (func_arg_count), \
+			.arg_types = memcpy(malloc(sizeof(arg_types)), \
+				arg_types, sizeof(arg_types)), \
+			.return_type = (func_ret_type), \
+			.actual_function = (actual_func_ptr) \
+		}); \
+	} while(0)
 
 // the function that does everything
-// starts child proc (if true), writes value to shared memory, kills child
-void eval_pnc_expr(char* input, bool spawn_child_proc);
+// runs every step in the current process and prints the result or the error,
+// an error only stops the current evaluation, never the whole session
+void eval_pnc_expr(char* input);
+
+// free everything the current evaluation allocated, in one go
+void eval_cleanup();
+
+// gmp and mpfr allocate all their limbs through these hooks
+// during an evaluation they come from ctx.arena, so eval_cleanup() frees
+// the limbs of every temporary and result together with everything else
+// outside of one (rt_init(), tests, benchmarks) they come from malloc
+void gmp_hooks_install();
+
+// set by threads of the pool, their limbs always come from malloc and
+// they stay out of ctx.gmp_stats, the arena belongs to the main thread
+extern _Thread_local bool gmp_heap_only;
+
+// what the gmp hooks did, reset at the start of every evaluation
+typedef struct {
+	size_t allocs;
+	size_t reallocs;
+	size_t frees;
+
+	// total bytes requested by allocs and by growing reallocs
+	size_t bytes;
+
+	// bytes of the limbs that were not freed yet, and the most they were
+	// limbs made before the evaluation do not count
+	size_t live;
+	size_t peak;
+} GmpAllocStats;
+
+// memory used by one evaluation, see :mem
+typedef struct {
+	// bytes the front end (tokenize, make_ast, parse) took from the arena,
+	// literals included
+	size_t front_bytes;
+
+	// everything the evaluation took from the arena: the front end,
+	// bytecode, lists and the limbs of new numbers
+	// total counts bytes that were given back early too
+	size_t arena_total;
+	size_t arena_peak;
+
+	// the limbs alone, wherever they came from
+	size_t gmp_total;
+	size_t gmp_peak;
+
+	// the most the heap memory counted against the limit ever was, the
+	// limbs of the threads included, 0 without a limit
+	size_t heap_peak;
+} MemStats;
+
+// how long the steps of evaluations took, for --timing and :stats
+
+typedef enum {
+	// tokenize, make_ast and parse are one step outside of PNC_DEBUG
+	// builds, all of it counts as PHASE_PARSE then
+	PHASE_TOKENIZE,
+	PHASE_MAKE_AST,
+	PHASE_PARSE,
+	PHASE_COMPILE,
+	PHASE_EVAL,
+	PHASE_PRINT,
+	PHASE_WRITE,
+	PHASE_CLEANUP,
+	PHASE_TOTAL,
+	NUM_PHASES
+} Phase;
+
+extern char* PHASE_NAMES[NUM_PHASES];
+
+typedef struct {
+	// nothing is measured unless this is set, by --timing or :timing on
+	bool enabled;
+
+	// set between timing_begin() and timing_end()
+	bool running;
+
+	// clock_ns() at the start of the evaluation and at the last mark
+	uint64_t start;
+	uint64_t last;
+
+	// the phase in progress, an eval_panic() ends it
+	Phase current;
+
+	// the current evaluation, phases it did not get to stay false
+	uint64_t ns[NUM_PHASES];
+	bool ran[NUM_PHASES];
+
+	// every evaluation since the start or the last :stats reset
+	LatencyHist hists[NUM_PHASES];
+} PhaseTiming;
+
+void timing_begin_enabled();
+void timing_mark_enabled(Phase p);
+void timing_end_enabled();
+
+// the guards keep the cost of disabled timing to a predicted branch
+#define timing_on() __builtin_expect(ctx.timing.enabled, 0)
+
+// starts timing an evaluation
+#define timing_begin() \
+	do { \
+		if (timing_on()) timing_begin_enabled(); \
+	} while(0)
+
+// the time since the last mark (or the start) was spent in phase p
+#define timing_mark(p) \
+	do { \
+		if (timing_on()) timing_mark_enabled(p); \
+	} while(0)
+
+// adds the evaluation to the totals and prints its timings to stderr
+#define timing_end() \
+	do { \
+		if (timing_on()) timing_end_enabled(); \
+	} while(0)
+
+// calls of every builtin, for --profile
+
+// the argument types of a call as a set, one bit each, the index into
+// BuiltinProfile.arg_mix
+typedef enum {
+	ARG_SMALL = 1, // integer that fits in an int64_t
+	ARG_BIG = 2, // any other integer
+	ARG_RATIONAL = 4,
+	ARG_REAL = 8,
+	ARG_LIST = 16, // list or range
+	NUM_ARG_MIXES = 32
+} ArgMix;
+
+typedef struct {
+	uint64_t calls;
+
+	// calls by the types of their arguments
+	uint64_t arg_mix[NUM_ARG_MIXES];
+
+	// calls that returned, the others ended in an eval_panic()
+	LatencyHist latency;
+} BuiltinProfile;
+
+// starts counting the calls of every builtin, they are written to path as
+// json by repl_quit(), false if path can not be written to
+// has to be called after rt_init()
+bool profile_init(char* path);
+
+// calls fd and counts the call
+Value profile_call(E_FuncData* fd, Value* args, int num_args);
+
+// writes the counts as json
+void profile_write(FILE* f);
+
+// writes the counts to the path given to profile_init() and frees them
+void profile_free();
+
+// calls a builtin, counted only if --profile is on
+#define call_builtin(fd, args, num_args) \
+	(__builtin_expect(ctx.profile != NULL, 0) \
+		? profile_call((fd), (args), (num_args)) \
+		: (fd)->actual_function((args), (num_args)))
 
 // repl stuff - manages everything else
 
@@ -405,6 +892,61 @@ typedef struct {
 	// should always be true
 	bool is_running;
 
+	// eval_panic() jumps back here, set by eval_pnc_expr()
+	jmp_buf eval_env;
+
+	// tokens, ast nodes and exprs of the current evaluation live here,
+	// eval_cleanup() resets it once the result is printed
+	Arena arena;
+
+	// value stack of the vm, grows to the biggest chunk ever run and is
+	// reused after that
+	Value* vm_stack;
+	int vm_stack_cap;
+
+	// same for eval()
+	struct EvalFrame* eval_frames;
+	int eval_frames_cap;
+	Value* eval_stack;
+	int eval_stack_cap;
+
+	// one per node for explain(), reused like the stacks
+	struct NodeStats* explain_nodes;
+	int explain_nodes_cap;
+
+	// true while an evaluation runs, then gmp allocates from arena
+	bool gmp_use_arena;
+	GmpAllocStats gmp_stats;
+
+	// the last evaluation (directives do not count) and the most any
+	// evaluation used
+	MemStats mem_last;
+	MemStats mem_max;
+	bool in_directive;
+
+	// set by rt_set_mem_limit(), the arena of every evaluation gets it
+	size_t mem_limit;
+
+	// limbs on the heap the evaluation holds (the fib memo, the threads of
+	// the pool), they count against the limit like the arena, can go
+	// below 0 when older limbs are freed
+	_Atomic int64_t mem_heap_bytes;
+	_Atomic int64_t mem_heap_peak;
+
+	// an allocation went over the limit during the current evaluation, see
+	// mem_check()
+	atomic_bool mem_exceeded;
+
+	// what the current evaluation prints, results and errors alike,
+	// eval_cleanup() writes it out, the memory is kept for the next one
+	dstr out;
+
+	PhaseTiming timing;
+
+	// one per builtin, NULL unless --profile is on
+	BuiltinProfile* profile;
+	FILE* profile_file;
+
 } REPLContext;
 
 // global context
@@ -440,7 +982,7 @@ typedef enum {
 	// unknown function name or variable name
 	RV_NAME_ERROR,
 
-	// malloc failed, fork failed, etc
+	// malloc failed, etc
 	RV_MEMORY_ERROR,
 
 	// something else happened (invariant error)
@@ -457,22 +999,22 @@ typedef char* ErrorString;
 // "value error: divide by zero"
 extern ErrorString CPRV_ERROR_NAMES[RV_N];
 
-// print value and exit
-#define childproc_return(v) \
+// print value
+#define eval_return(v) \
 	do { \
-		fputs("= ", stdout); \
+		dstr_append(ctx.out, "= "); \
 		print_value(v); \
-		fputc('\n', stdout); \
-		exit(RV_OK); \
+		dstr_append_char(ctx.out, '\n'); \
 	} while(0)
 
-// print error message and exit
-#define childproc_panic(rv, fmt, ...) \
+// print error message and abandon the current evaluation
+// control goes back to eval_pnc_expr(), which cleans up
+#define eval_panic(rv, fmt, ...) \
 	do { \
-		printf("= %s: " fmt "\n", \
+		dstr_printf(&ctx.out, "= %s: " fmt "\n", \
 			CPRV_ERROR_NAMES[(rv)] \
 			__VA_OPT__(,) __VA_ARGS__); \
-		exit(rv); \
+		longjmp(ctx.eval_env, (rv)); \
 	} while(0)
 
 #endif // PNC_H
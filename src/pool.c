@@ -0,0 +1,132 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+static struct {
+	pthread_mutex_t lock;
+
+	// workers wait here for the next job
+	pthread_cond_t work;
+
+	// pool_run() waits here for the workers to finish a job
+	pthread_cond_t done;
+
+	int size;
+	pthread_t* workers;
+	int num_workers;
+
+	// the current job
+	PoolTask* task;
+	void* arg;
+	int n;
+	int next; // next iteration to hand out
+	int running; // workers that have not finished the job yet
+
+	// counts jobs, a worker knows there is a new one when it changes
+	unsigned long generation;
+
+	bool stopping;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+	.size = 1,
+};
+
+// runs iterations of the current job until there are none left
+// the lock is held before and after
+static void pool_work() {
+	while (pool.next < pool.n) {
+		int i = pool.next++;
+		pthread_mutex_unlock(&pool.lock);
+		pool.task(pool.arg, i);
+		pthread_mutex_lock(&pool.lock);
+	}
+}
+
+// arg is the generation when the worker was started, the jobs before it
+// are none of its business
+static void* pool_worker(void* arg) {
+	unsigned long seen = (uintptr_t)arg;
+
+	pthread_mutex_lock(&pool.lock);
+	while (true) {
+		while (pool.generation == seen && !pool.stopping) {
+			pthread_cond_wait(&pool.work, &pool.lock);
+		}
+		if (pool.stopping) {
+			break;
+		}
+		seen = pool.generation;
+
+		pool_work();
+
+		pool.running--;
+		if (pool.running == 0) {
+			pthread_cond_signal(&pool.done);
+		}
+	}
+	pthread_mutex_unlock(&pool.lock);
+	return NULL;
+}
+
+void pool_init(int num_threads) {
+	pool_free();
+	pool.size = (num_threads < 1) ? 1 : num_threads;
+}
+
+int pool_size() {
+	return pool.size;
+}
+
+void pool_run(PoolTask* task, void* arg, int n) {
+	// started on first use, most sessions never need them
+	// if some could not be started, the others do all the work
+	if (pool.workers == NULL && pool.size > 1) {
+		pool.workers = malloc(sizeof(pthread_t) * (pool.size - 1));
+		void* gen = (void*)(uintptr_t)pool.generation;
+		for (int i = 0; i < pool.size - 1; i++) {
+			if (pthread_create(&pool.workers[i], NULL, pool_worker, gen)
+			!= 0) {
+				break;
+			}
+			pool.num_workers++;
+		}
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	pool.task = task;
+	pool.arg = arg;
+	pool.n = n;
+	pool.next = 0;
+	pool.running = pool.num_workers;
+	pool.generation++;
+	pthread_cond_broadcast(&pool.work);
+
+	pool_work();
+
+	// every worker has to see the job, even if there was nothing left
+	// for it, or it would mistake the next job for this one
+	while (pool.running > 0) {
+		pthread_cond_wait(&pool.done, &pool.lock);
+	}
+	pthread_mutex_unlock(&pool.lock);
+}
+
+void pool_free() {
+	pthread_mutex_lock(&pool.lock);
+	pool.stopping = true;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (int i = 0; i < pool.num_workers; i++) {
+		pthread_join(pool.workers[i], NULL);
+	}
+	free(pool.workers);
+	pool.workers = NULL;
+	pool.num_workers = 0;
+	pool.stopping = false;
+}
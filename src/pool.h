@@ -0,0 +1,26 @@
+#ifndef POOL_H
+#define POOL_H
+
+// fixed set of worker threads that run the iterations of a loop
+// the threads are started by the first pool_run() and then reused
+
+// one iteration, i is the index of the iteration
+typedef void PoolTask(void* arg, int i);
+
+// sets the number of threads, the caller of pool_run() counts as one
+// of them, so 1 means no worker threads at all
+// has to be called while no pool_run() is running
+void pool_init(int num_threads);
+
+// the number passed to pool_init(), 1 before that
+int pool_size();
+
+// runs task(arg, i) for every i in [0, n) and returns once all of them
+// are done, the caller runs tasks too
+// tasks run in no particular order and must not call eval_panic()
+void pool_run(PoolTask* task, void* arg, int n);
+
+// stops and joins the worker threads
+void pool_free();
+
+#endif // POOL_H
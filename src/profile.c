@@ -0,0 +1,162 @@
+#include "pnc.h"
+
+// call counts, argument types and latencies of the builtins, see
+// --profile
+
+static char* profile_path;
+
+// one letter per ArgMix bit, in bit order
+static char ARG_MIX_LETTERS[] = "SZQRL";
+
+bool profile_init(char* path) {
+	FILE* f = fopen(path, "w");
+	if (f == NULL) {
+		return false;
+	}
+
+	profile_free();
+	ctx.profile_file = f;
+	profile_path = path;
+	ctx.profile = calloc(RT_BUILTIN_FUNCTIONS.num_fns,
+		sizeof(BuiltinProfile));
+	return true;
+}
+
+static int arg_mix(Value* args, int num_args) {
+	int mix = 0;
+	for (int i = 0; i < num_args; i++) {
+		if (value_is_list(args[i])) {
+			mix |= ARG_LIST;
+			continue;
+		}
+
+		Number* n = &args[i].number_value;
+		switch (n->type) {
+			case NUM_INTEGER:
+				mix |= n->is_small ? ARG_SMALL : ARG_BIG;
+				break;
+			case NUM_RATIONAL:
+				mix |= ARG_RATIONAL;
+				break;
+			case NUM_REAL:
+				mix |= ARG_REAL;
+				break;
+		}
+	}
+	return mix;
+}
+
+Value profile_call(E_FuncData* fd, Value* args, int num_args) {
+	BuiltinProfile* p = &ctx.profile[fd - RT_BUILTIN_FUNCTIONS.fns];
+
+	// counted before the call, an eval_panic() in it does not come back
+	p->calls++;
+	p->arg_mix[arg_mix(args, num_args)]++;
+
+	uint64_t start = clock_ns();
+	Value result = fd->actual_function(args, num_args);
+	hist_add(&p->latency, clock_ns() - start);
+
+	return result;
+}
+
+static void write_json_str(FILE* f, char* s) {
+	fputc('"', f);
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\') {
+			fputc('\\', f);
+		}
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+// hottest first
+static int cmp_total_time(const void* a, const void* b) {
+	uint64_t ta = ctx.profile[*(const int*)a].latency.sum;
+	uint64_t tb = ctx.profile[*(const int*)b].latency.sum;
+	return (ta < tb) - (ta > tb);
+}
+
+void profile_write(FILE* f) {
+	int num_fns = RT_BUILTIN_FUNCTIONS.num_fns;
+	int* order = malloc(sizeof(int) * num_fns);
+	int num_called = 0;
+	for (int i = 0; i < num_fns; i++) {
+		if (ctx.profile[i].calls > 0) {
+			order[num_called++] = i;
+		}
+	}
+	qsort(order, num_called, sizeof(int), cmp_total_time);
+
+	fputs("{\"builtins\": [", f);
+	for (int k = 0; k < num_called; k++) {
+		BuiltinProfile* p = &ctx.profile[order[k]];
+		LatencyHist* h = &p->latency;
+
+		fputs((k == 0) ? "\n  {\"name\": " : ",\n  {\"name\": ", f);
+		write_json_str(f, RT_BUILTIN_FUNCTIONS.fns[order[k]].name);
+		fprintf(f, ", \"calls\": %llu, \"errors\": %llu, \"total_ns\": %llu, "
+			"\"mean_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, "
+			"\"p99_ns\": %llu, \"max_ns\": %llu,\n   \"arg_mix\": {",
+			(unsigned long long)p->calls,
+			(unsigned long long)(p->calls - h->count),
+			(unsigned long long)h->sum,
+			(unsigned long long)(h->count ? h->sum / h->count : 0),
+			(unsigned long long)hist_percentile(h, 50),
+			(unsigned long long)hist_percentile(h, 90),
+			(unsigned long long)hist_percentile(h, 99),
+			(unsigned long long)h->max);
+
+		// "SQ" is a call with small integers and rationals, "" one without
+		// arguments
+		bool first = true;
+		for (int mix = 0; mix < NUM_ARG_MIXES; mix++) {
+			if (p->arg_mix[mix] == 0) {
+				continue;
+			}
+			fputs(first ? "\"" : ", \"", f);
+			for (int bit = 0; bit < 5; bit++) {
+				if (mix & (1 << bit)) {
+					fputc(ARG_MIX_LETTERS[bit], f);
+				}
+			}
+			fprintf(f, "\": %llu", (unsigned long long)p->arg_mix[mix]);
+			first = false;
+		}
+
+		// [le_ns, count] for every bucket that is not empty, le_ns is the
+		// biggest latency in the bucket
+		fputs("},\n   \"latency_hist\": [", f);
+		first = true;
+		for (int i = 0; i < HIST_BUCKETS; i++) {
+			if (h->buckets[i] == 0) {
+				continue;
+			}
+			fprintf(f, "%s[%llu, %llu]", first ? "" : ", ",
+				(unsigned long long)hist_bucket_end(i),
+				(unsigned long long)h->buckets[i]);
+			first = false;
+		}
+		fputs("]}", f);
+	}
+	fputs("\n]}\n", f);
+
+	free(order);
+}
+
+void profile_free() {
+	if (ctx.profile == NULL) {
+		return;
+	}
+
+	profile_write(ctx.profile_file);
+	if (fclose(ctx.profile_file) != 0) {
+		fprintf(stderr, "could not write profile to %s: %s\n",
+			profile_path, strerror(errno));
+	}
+
+	free(ctx.profile);
+	ctx.profile = NULL;
+	ctx.profile_file = NULL;
+}
@@ -3,19 +3,810 @@
 
 // implementation of all builtin functions available during runtime
 
-Value e_func_add(Expr* e) {
+Value e_func_add(Value* args, int num_args) {
+	(void)num_args;
 
-	Value arg0 = try_eval_arg_as_type(e, 0, V_NUM);
-	Value arg1 = try_eval_arg_as_type(e, 1, V_NUM);
-
-	Number n0 = arg0.number_value;
-	Number n1 = arg1.number_value;
+	Number n0 = args[0].number_value;
+	Number n1 = args[1].number_value;
 
 	return (Value){
 		.type = V_NUM,
 		.number_value = num_add(n0, n1)
 	};
 }
+
+Value e_func_list(Value* args, int num_args) {
+
+	NumberList result = nl_new();
+
+	// the arguments are all there already, so the list never grows
+	nl_reserve(&result, num_args);
+
+	for (int i = 0; i < num_args; i++) {
+		nl_append(&result, args[i].number_value);
+	}
+
+	return (Value){
+		.type = V_LIST,
+		.list_value = result
+	};
+}
+
+// number of integers in r, max(0, ceil((stop - start) / step))
+// n has to be initialized
+static void range_len(NumberRange* r, mpz_t n) {
+	mpz_t v0, v1, v2;
+	mp_limb_t l0, l1, l2;
+
+	mpz_sub(n, num_z(&r->stop, v1, &l1), num_z(&r->start, v0, &l0));
+	mpz_cdiv_q(n, n, num_z(&r->step, v2, &l2));
+	if (mpz_sgn(n) < 0) {
+		mpz_set_ui(n, 0);
+	}
+}
+
+Value e_func_len(Value* args, int num_args) {
+	(void)num_args;
+
+	if (args[0].type == V_LIST) {
+		return (Value){
+			.type = V_NUM,
+			.number_value = num_small(args[0].list_value.num_nums)
+		};
+	}
+
+	Number result = { .type = NUM_INTEGER, .base = 10 };
+	mpz_init(result.integer_value);
+	range_len(args[0].range_value, result.integer_value);
+
+	return (Value){
+		.type = V_NUM,
+		.number_value = *num_demote_integer(&result)
+	};
+}
+
+// sum and prod of big lists are split into chunks that the threads of the
+// pool reduce on their own, then the partial results are combined in a
+// balanced tree, partial 0 with partial 1, 2 with 3 and so on
+// only exact lists go this way, integer and rational arithmetic does not
+// care about the order so the result is exactly what a left fold gives,
+// a real anywhere in the list means a sequential fold
+// the threads keep their limbs on the heap (gmp_heap_only), only the final
+// result is copied into the arena
+// they count against the memory limit too, once it is hit the threads
+// drop what is left of the work and reduce_tree() stops the evaluation
+
+// smallest chunk worth handing to a thread
+#define REDUCE_CHUNK_MIN 512
+
+// below this prod multiplies from left to right
+#define REDUCE_PROD_MIN 32
+
+typedef struct {
+	Value list; // a list or a range
+	int len;
+	bool mul;
+
+	Number* parts; // one per chunk
+	int num_chunks;
+
+	// distance between the two partial results a tree level combines
+	int width;
+} Reduction;
+
+// a thread ran into the memory limit, see mem_check()
+#define reduce_abandoned() \
+	atomic_load_explicit(&ctx.mem_exceeded, memory_order_relaxed)
+
+// true if the list has no reals in it
+static bool list_is_exact(Value list) {
+	if (list.type == V_RANGE || !list.list_value.unpacked) {
+		return true;
+	}
+
+	NumberList* nl = &list.list_value;
+	for (int i = 0; i < nl->num_nums; i++) {
+		if (nl->nums[i].type == NUM_REAL) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// product of the numbers lo to hi - 1, multiplied in a balanced tree so
+// that the big multiplications get operands of about the same size
+static Number reduce_prod(Reduction* red, int lo, int hi) {
+	int n = hi - lo;
+	// the scratch space alone can be too much
+	size_t t_bytes = sizeof(Number) * ((n + 1) / 2);
+	if (!mem_heap_fits(t_bytes)) {
+		atomic_store(&ctx.mem_exceeded, true);
+		return num_small(1);
+	}
+
+	Number* t = malloc(t_bytes);
+	if (t == NULL) {
+		fputs("fatal: out of memory\n", stderr);
+		abort();
+	}
+	mem_count_heap(t_bytes, 0);
+
+	// a range is walked from start + lo * step
+	Number cur = num_small(lo);
+	if (red->list.type == V_RANGE) {
+		num_mul_into(&cur, &red->list.range_value->step);
+		num_add_into(&cur, &red->list.range_value->start);
+	}
+
+	// the first level multiplies neighbours right away, no copies needed
+	for (int k = 0; k < n; k++) {
+		// the numbers in t so far are what is left to clean up
+		if (reduce_abandoned()) {
+			n = k;
+			break;
+		}
+
+		Number x = (red->list.type == V_LIST)
+			? nl_get(red->list.list_value, lo + k)
+			: cur;
+
+		if (k % 2 == 0) {
+			t[k / 2] = num_small(1);
+		}
+		num_mul_into(&t[k / 2], &x);
+
+		if (red->list.type == V_RANGE) {
+			num_add_into(&cur, &red->list.range_value->step);
+		}
+	}
+	num_clear(cur);
+
+	int m = (n + 1) / 2;
+	while (m > 1 && !reduce_abandoned()) {
+		for (int k = 0; k < m / 2; k++) {
+			num_mul_into(&t[2 * k], &t[2 * k + 1]);
+			num_clear(t[2 * k + 1]);
+			t[k] = t[2 * k];
+		}
+		if (m % 2 == 1) {
+			t[m / 2] = t[m - 1];
+		}
+		m = (m + 1) / 2;
+	}
+
+	if (m != 1) {
+		for (int k = 0; k < m; k++) {
+			num_clear(t[k]);
+		}
+		free(t);
+		mem_count_heap(0, t_bytes);
+		return num_small(1);
+	}
+
+	Number result = t[0];
+	free(t);
+	mem_count_heap(0, t_bytes);
+	return result;
+}
+
+static void reduce_chunk(void* arg, int i) {
+	Reduction* red = arg;
+	bool heap_only = gmp_heap_only;
+	gmp_heap_only = true;
+
+	int lo = (int64_t)red->len * i / red->num_chunks;
+	int hi = (int64_t)red->len * (i + 1) / red->num_chunks;
+
+	if (red->mul) {
+		red->parts[i] = reduce_prod(red, lo, hi);
+	} else {
+		// sums only come here for unpacked lists, ranges have a closed
+		// form and packed lists the simd kernels
+		NumberSum s;
+		num_sum_init(&s);
+		for (int k = lo; k < hi && !reduce_abandoned(); k++) {
+			num_sum_add(&s, &red->list.list_value.nums[k]);
+		}
+		red->parts[i] = num_sum_finish(&s);
+	}
+
+	gmp_heap_only = heap_only;
+}
+
+static void reduce_level(void* arg, int j) {
+	Reduction* red = arg;
+	bool heap_only = gmp_heap_only;
+	gmp_heap_only = true;
+
+	Number* a = &red->parts[j * 2 * red->width];
+	Number* b = a + red->width;
+	if (reduce_abandoned()) {
+		// a is thrown away anyway
+	} else if (red->mul) {
+		num_mul_into(a, b);
+	} else {
+		num_add_into(a, b);
+	}
+	num_clear(*b);
+
+	gmp_heap_only = heap_only;
+}
+
+// sum or product of the len numbers of an exact list, len > 0
+static Number reduce_tree(Value list, int len, bool mul) {
+	Reduction red = {
+		.list = list,
+		.len = len,
+		.mul = mul,
+	};
+
+	red.num_chunks = len / REDUCE_CHUNK_MIN;
+	red.num_chunks = min(red.num_chunks, pool_size() * 4);
+	red.num_chunks = max(red.num_chunks, 1);
+	red.parts = arena_alloc(&ctx.arena, sizeof(Number) * red.num_chunks);
+
+	pool_run(reduce_chunk, &red, red.num_chunks);
+
+	for (red.width = 1; red.width < red.num_chunks; red.width *= 2) {
+		// partials j * 2 * width that have a partner width further on
+		int pairs = (red.num_chunks + red.width - 1) / (2 * red.width);
+		pool_run(reduce_level, &red, pairs);
+	}
+
+	Number* part = &red.parts[0];
+	size_t limbs = 0;
+	if (part->type == NUM_RATIONAL) {
+		limbs = mpz_size(mpq_numref(part->rational_value))
+			+ mpz_size(mpq_denref(part->rational_value));
+	} else if (!part->is_small) {
+		limbs = mpz_size(part->integer_value);
+	}
+
+	// the partial is on the heap, it must not leak when the copy runs
+	// into the memory limit
+	bool fits = !reduce_abandoned()
+		&& mem_fits(limbs * sizeof(mp_limb_t));
+
+	Number result = num_small(0);
+	if (fits) {
+		num_set(&result, part);
+	}
+
+	// printed in the base of the first number, like a left fold
+	result.base = (list.type == V_RANGE)
+		? list.range_value->start.base
+		: nl_get(list.list_value, 0).base;
+
+	bool heap_only = gmp_heap_only;
+	gmp_heap_only = true;
+	num_clear(*part);
+	gmp_heap_only = heap_only;
+
+	if (!fits) {
+		mem_limit_panic();
+	}
+
+	return result;
+}
+
+Value e_func_sum(Value* args, int num_args) {
+	(void)num_args;
+
+	if (args[0].type == V_RANGE) {
+		NumberRange* r = args[0].range_value;
+		mpz_t v0, v2;
+		mp_limb_t l0, l2;
+
+		// n*start + step*n*(n - 1)/2
+		mpz_t n;
+		mpz_init(n);
+		range_len(r, n);
+
+		Number result = { .type = NUM_INTEGER, .base = r->start.base };
+		mpz_ptr t = result.integer_value;
+		mpz_init(t);
+		mpz_sub_ui(t, n, 1);
+		mpz_mul(t, t, n);
+		mpz_divexact_ui(t, t, 2);
+		mpz_mul(t, t, num_z(&r->step, v2, &l2));
+		mpz_addmul(t, n, num_z(&r->start, v0, &l0));
+		mpz_clear(n);
+
+		return (Value){
+			.type = V_NUM,
+			.number_value = *num_demote_integer(&result)
+		};
+	}
+
+	NumberList* nl = &args[0].list_value;
+
+	// packed list, add up plain int64_t values until one overflows
+	if (!nl->unpacked) {
+		Number result = num_small(0);
+		result.base = nl->base;
+
+		if (simd.sum(nl->ints, nl->num_nums, &result.small_value)) {
+			return (Value){
+				.type = V_NUM,
+				.number_value = result
+			};
+		}
+
+		int64_t part = 0;
+		for (int i = 0; i < nl->num_nums; i++) {
+			int64_t next;
+			if (small_add(part, nl->ints[i], &next)) {
+				part = next;
+				continue;
+			}
+
+			Number p = num_small(part);
+			num_add_into(&result, &p);
+			part = nl->ints[i];
+		}
+
+		Number p = num_small(part);
+		num_add_into(&result, &p);
+
+		return (Value){
+			.type = V_NUM,
+			.number_value = result
+		};
+	}
+
+	// only worth it with other threads to share the work
+	if (pool_size() > 1 && nl->num_nums >= 2 * REDUCE_CHUNK_MIN
+	&& list_is_exact(args[0])) {
+		return (Value){
+			.type = V_NUM,
+			.number_value = reduce_tree(args[0], nl->num_nums, false)
+		};
+	}
+
+	NumberSum s;
+	num_sum_init(&s);
+	for (int i = 0; i < nl->num_nums; i++) {
+		num_sum_add(&s, &nl->nums[i]);
+	}
+
+	return (Value){
+		.type = V_NUM,
+		.number_value = num_sum_finish(&s)
+	};
+}
+
+Value e_func_prod(Value* args, int num_args) {
+	(void)num_args;
+
+	int len;
+	uint8_t base = 10;
+	if (args[0].type == V_RANGE) {
+		mpz_t n;
+		mpz_init(n);
+		range_len(args[0].range_value, n);
+		if (!mpz_fits_sint_p(n)) {
+			eval_panic(RV_VALUE_ERROR,
+				"argument #0 of function 'prod' is too long");
+		}
+		len = mpz_get_si(n);
+		mpz_clear(n);
+		base = args[0].range_value->start.base;
+	} else {
+		len = args[0].list_value.num_nums;
+		if (!args[0].list_value.unpacked) {
+			base = args[0].list_value.base;
+		} else if (len > 0) {
+			base = args[0].list_value.nums[0].base;
+		}
+	}
+
+	Number result = num_small(1);
+
+	// the tree pays off even without other threads, a product of many
+	// numbers gets big and gmp multiplies two big halves much faster than
+	// it multiplies a big number by a small one over and over
+	if (len >= REDUCE_PROD_MIN && list_is_exact(args[0])) {
+		result = reduce_tree(args[0], len, true);
+	} else {
+		Number x;
+		ListIter it = list_iter_new(args[0]);
+		while (list_iter_next(&it, &x)) {
+			num_mul_into(&result, &x);
+		}
+	}
+
+	result.base = base;
+	return (Value){
+		.type = V_NUM,
+		.number_value = result
+	};
+}
+
+Value e_func_range(Value* args, int num_args) {
+
+	if (num_args != 2 && num_args != 3) {
+		eval_panic(RV_VALUE_ERROR,
+			"function 'range' got %d arguments, expected 2 or 3",
+			num_args);
+	}
+
+	for (int i = 0; i < num_args; i++) {
+		if (args[i].number_value.type != NUM_INTEGER) {
+			eval_panic(RV_VALUE_ERROR,
+				"argument #%d of function 'range' is not an integer", i);
+		}
+	}
+
+	NumberRange* r = arena_alloc(&ctx.arena, sizeof(NumberRange));
+	r->start = args[0].number_value;
+	r->stop = args[1].number_value;
+	r->step = (num_args == 3) ? args[2].number_value : num_small(1);
+
+	if (num_integer_sgn(&r->step) == 0) {
+		eval_panic(RV_VALUE_ERROR,
+			"argument #2 of function 'range' cannot be 0");
+	}
+
+	return (Value){
+		.type = V_RANGE,
+		.range_value = r
+	};
+}
+
+// last number of a range that is not empty, start + (n - 1) * step
+static Number range_last(NumberRange* r, mpz_t n) {
+	mpz_t v0, v2;
+	mp_limb_t l0, l2;
+
+	Number last = { .type = NUM_INTEGER, .base = r->start.base };
+	mpz_init(last.integer_value);
+	mpz_sub_ui(last.integer_value, n, 1);
+	mpz_mul(last.integer_value, last.integer_value, num_z(&r->step, v2, &l2));
+	mpz_add(last.integer_value, last.integer_value,
+		num_z(&r->start, v0, &l0));
+	return *num_demote_integer(&last);
+}
+
+// smallest or biggest number of a list or a range
+static Value list_extreme(Value list, char* func_name, bool biggest) {
+	Number result;
+
+	if (list.type == V_RANGE) {
+		NumberRange* r = list.range_value;
+
+		mpz_t n;
+		mpz_init(n);
+		range_len(r, n);
+		if (mpz_sgn(n) == 0) {
+			eval_panic(RV_VALUE_ERROR,
+				"argument #0 of function '%s' is an empty list", func_name);
+		}
+
+		bool up = num_integer_sgn(&r->step) > 0;
+		result = (up == biggest) ? range_last(r, n) : r->start;
+		mpz_clear(n);
+	}
+
+	else if (list.list_value.num_nums == 0) {
+		eval_panic(RV_VALUE_ERROR,
+			"argument #0 of function '%s' is an empty list", func_name);
+	}
+
+	else if (!list.list_value.unpacked) {
+		NumberList* nl = &list.list_value;
+		int64_t lo, hi;
+		simd.minmax(nl->ints, nl->num_nums, &lo, &hi);
+		result = num_small(biggest ? hi : lo);
+		result.base = nl->base;
+	}
+
+	else {
+		NumberList* nl = &list.list_value;
+		result = nl->nums[0];
+		for (int i = 1; i < nl->num_nums; i++) {
+			int c = num_cmp(&nl->nums[i], &result);
+			if (biggest ? (c > 0) : (c < 0)) {
+				result = nl->nums[i];
+			}
+		}
+	}
+
+	return (Value){
+		.type = V_NUM,
+		.number_value = result
+	};
+}
+
+Value e_func_min(Value* args, int num_args) {
+	(void)num_args;
+	return list_extreme(args[0], "min", false);
+}
+
+Value e_func_max(Value* args, int num_args) {
+	(void)num_args;
+	return list_extreme(args[0], "max", true);
+}
+
+// writes x to out as an integer, false if x is not a whole number
+static bool num_as_integer(const Number* x, mpz_t out) {
+	mpz_t v;
+	mp_limb_t l;
+
+	switch (x->type) {
+		case NUM_INTEGER:
+			mpz_set(out, num_z(x, v, &l));
+			return true;
+		case NUM_RATIONAL:
+			if (!mpz_divisible_p(mpq_numref(x->rational_value),
+				mpq_denref(x->rational_value))) {
+				return false;
+			}
+			mpz_divexact(out, mpq_numref(x->rational_value),
+				mpq_denref(x->rational_value));
+			return true;
+		case NUM_REAL:
+			if (!mpfr_integer_p(x->real_value)) {
+				return false;
+			}
+			mpfr_get_z(out, x->real_value, MPFR_RNDN);
+			return true;
+	}
+	return false;
+}
+
+// how many numbers of the list are equal to x
+Value e_func_count(Value* args, int num_args) {
+	(void)num_args;
+
+	Number* x = &args[1].number_value;
+	int64_t count = 0;
+
+	if (args[0].type == V_RANGE) {
+		NumberRange* r = args[0].range_value;
+		mpz_t v0, v2;
+		mp_limb_t l0, l2;
+
+		// x is in the range if x = start + k * step for 0 <= k < len
+		mpz_t k, n;
+		mpz_init(k);
+		mpz_init(n);
+		if (num_as_integer(x, k)) {
+			mpz_sub(k, k, num_z(&r->start, v0, &l0));
+			mpz_srcptr step = num_z(&r->step, v2, &l2);
+			if (mpz_divisible_p(k, step)) {
+				mpz_divexact(k, k, step);
+				range_len(r, n);
+				count = mpz_sgn(k) >= 0 && mpz_cmp(k, n) < 0;
+			}
+		}
+		mpz_clear(k);
+		mpz_clear(n);
+	}
+
+	else if (!args[0].list_value.unpacked && x->is_small) {
+		NumberList* nl = &args[0].list_value;
+		count = simd.count_eq(nl->ints, nl->num_nums, x->small_value);
+	}
+
+	else {
+		Number y;
+		ListIter it = list_iter_new(args[0]);
+		while (list_iter_next(&it, &y)) {
+			count += num_cmp(&y, x) == 0;
+		}
+	}
+
+	return (Value){
+		.type = V_NUM,
+		.number_value = num_small(count)
+	};
+}
+
+// sum of the products of the numbers at the same index
+Value e_func_dot(Value* args, int num_args) {
+	(void)num_args;
+
+	ListIter a = list_iter_new(args[0]);
+	ListIter b = list_iter_new(args[1]);
+
+	if (args[0].type == V_LIST && args[1].type == V_LIST) {
+		NumberList* nl_a = &args[0].list_value;
+		NumberList* nl_b = &args[1].list_value;
+
+		if (nl_a->num_nums != nl_b->num_nums) {
+			eval_panic(RV_VALUE_ERROR,
+				"lists given to 'dot' have different lengths (%d and %d)",
+				nl_a->num_nums, nl_b->num_nums);
+		}
+
+		Number result = num_small(0);
+		result.base = nl_a->base;
+		if (!nl_a->unpacked && !nl_b->unpacked
+		&& simd.dot(nl_a->ints, nl_b->ints, nl_a->num_nums,
+			&result.small_value)) {
+			return (Value){
+				.type = V_NUM,
+				.number_value = result
+			};
+		}
+	}
+
+	// a range on either side, a generic list or an overflow
+	Number result = num_small(0);
+	Number p = num_small(0);
+	Number x, y;
+	while (true) {
+		bool more_a = list_iter_next(&a, &x);
+		bool more_b = list_iter_next(&b, &y);
+		if (more_a != more_b) {
+			eval_panic(RV_VALUE_ERROR,
+				"lists given to 'dot' have different lengths");
+		}
+		if (!more_a) {
+			break;
+		}
+
+		num_set(&p, &x);
+		num_mul_into(&p, &y);
+		num_add_into(&result, &p);
+	}
+	num_clear(p);
+
+	return (Value){
+		.type = V_NUM,
+		.number_value = result
+	};
+}
+
+// fib of a big n takes a while, so the last few results are kept
+// an entry also answers a query up to FIB_MEMO_REACH away from it, by
+// stepping with one addition per position, and then moves to that n
+#define FIB_MEMO_SIZE 32
+#define FIB_MEMO_REACH 1024
+
+// the memo never holds more than this
+#define FIB_MEMO_MAX_BYTES (64 * 1024 * 1024)
+
+// smaller n are computed directly, that is faster than a lookup
+#define FIB_MEMO_MIN 10000
+
+// fib(n) has about 0.69 * n bits
+#define FIB_N_MAX 100000000
+
+typedef struct {
+	unsigned long n; // 0 marks an empty slot
+	mpz_t f; // fib(n)
+	mpz_t f_prev; // fib(n - 1)
+} FibMemoEntry;
+
+// the limbs are on the heap, they outlive every evaluation
+static FibMemoEntry fib_memo[FIB_MEMO_SIZE];
+static int fib_memo_next; // slot to replace next, oldest first
+static size_t fib_memo_bytes;
+
+#define fib_entry_bytes(e) \
+	((mpz_size((e)->f) + mpz_size((e)->f_prev)) * sizeof(mp_limb_t))
+
+static void fib_memo_drop(FibMemoEntry* e) {
+	if (e->n != 0) {
+		fib_memo_bytes -= fib_entry_bytes(e);
+		mpz_clear(e->f);
+		mpz_clear(e->f_prev);
+		e->n = 0;
+	}
+}
+
+void fib_memo_clear() {
+	for (int i = 0; i < FIB_MEMO_SIZE; i++) {
+		fib_memo_drop(&fib_memo[i]);
+	}
+	fib_memo_next = 0;
+}
+
+// the memo entry that holds fib(n) afterwards
+static FibMemoEntry* fib_memo_get(unsigned long n) {
+	FibMemoEntry* e = NULL;
+	unsigned long best = FIB_MEMO_REACH + 1;
+
+	for (int i = 0; i < FIB_MEMO_SIZE; i++) {
+		if (fib_memo[i].n == 0) {
+			continue;
+		}
+		unsigned long d = (fib_memo[i].n > n)
+			? fib_memo[i].n - n
+			: n - fib_memo[i].n;
+		if (d < best) {
+			e = &fib_memo[i];
+			best = d;
+		}
+	}
+
+	if (e == NULL) {
+		e = &fib_memo[fib_memo_next];
+		fib_memo_next = (fib_memo_next + 1) % FIB_MEMO_SIZE;
+		fib_memo_drop(e);
+
+		// a new entry needs room for about 2 * 0.7 * n bits, the oldest
+		// entries make room for it
+		size_t need = n / 4;
+		for (int i = 0; i < FIB_MEMO_SIZE
+		&& fib_memo_bytes + need > FIB_MEMO_MAX_BYTES; i++) {
+			fib_memo_drop(&fib_memo[(fib_memo_next + i) % FIB_MEMO_SIZE]);
+		}
+
+		mpz_init(e->f);
+		mpz_init(e->f_prev);
+		mpz_fib2_ui(e->f, e->f_prev, n);
+		e->n = n;
+		fib_memo_bytes += fib_entry_bytes(e);
+		return e;
+	}
+
+	fib_memo_bytes -= fib_entry_bytes(e);
+
+	// (f, f_prev) -> (f + f_prev, f)
+	for (; e->n < n; e->n++) {
+		mpz_add(e->f_prev, e->f_prev, e->f);
+		mpz_swap(e->f, e->f_prev);
+	}
+
+	// (f, f_prev) -> (f_prev, f - f_prev)
+	for (; e->n > n; e->n--) {
+		mpz_sub(e->f, e->f, e->f_prev);
+		mpz_swap(e->f, e->f_prev);
+	}
+
+	fib_memo_bytes += fib_entry_bytes(e);
+	return e;
+}
+
+Value e_func_fib(Value* args, int num_args) {
+	(void)num_args;
+
+	Number* arg = &args[0].number_value;
+
+	if (arg->type != NUM_INTEGER) {
+		eval_panic(RV_VALUE_ERROR,
+			"argument #0 of function 'fib' is not an integer");
+	}
+	if (num_integer_sgn(arg) < 0) {
+		eval_panic(RV_VALUE_ERROR,
+			"argument #0 of function 'fib' cannot be negative");
+	}
+	if (!arg->is_small || arg->small_value > FIB_N_MAX) {
+		eval_panic(RV_VALUE_ERROR,
+			"argument #0 of function 'fib' cannot be more than %d",
+			FIB_N_MAX);
+	}
+
+	unsigned long n = arg->small_value;
+
+	Number result = { .type = NUM_INTEGER, .base = arg->base };
+	mpz_init(result.integer_value);
+
+	// fib(n) has about 0.69 * n bits, gmp would spend seconds on one
+	// that cannot be kept before the limit could stop it
+	if (!mem_fits(n / 12)) {
+		mem_limit_panic();
+	}
+
+	if (n < FIB_MEMO_MIN) {
+		mpz_fib_ui(result.integer_value, n);
+	} else {
+		// the memo outlives the evaluation, so its limbs come from the heap
+		bool use_arena = ctx.gmp_use_arena;
+		ctx.gmp_use_arena = false;
+		FibMemoEntry* e = fib_memo_get(n);
+		ctx.gmp_use_arena = use_arena;
+
+		mpz_set(result.integer_value, e->f);
+	}
+
+	return (Value){
+		.type = V_NUM,
+		.number_value = *num_demote_integer(&result)
+	};
+}
 /*
 Value e_func_sub(Expr* e) {
 
@@ -169,112 +960,6 @@ Value e_func_bool(struct Expr* e) {
 	};
 }
 
-size_t e_func_fib_r(size_t n) {
-	if (n < 2)
-		return 1;
-	else
-		return e_func_fib_r(n-1) + e_func_fib_r(n-2);
-}
-
-Value e_func_fib(struct Expr* e) {
-
-	Value arg0 = try_eval_arg_as_type(e, 0, V_NUM);
-
-	Number n0 = arg0.number_value;
-
-	return (Value){
-		.type = V_NUM,
-		.number_value = num(e_func_fib_r(n0.value))
-	};
-}
-
-Value e_func_list(struct Expr* e) {
-
-	NumberList result = nl_new();
-
-	// empty list
-	if (e->funccall.num_args_passed == 0) {
-		return (Value){
-			.type = V_LIST,
-			.list_value = result
-		};
-	}
-
-	for (int i = 0; i < e->funccall.num_args_passed; i++) {
-
-		// manually doing try_eval_arg_as_type to print a specific msg
-
-		Value list_item = eval(e->funccall.args[i]);
-
-		if (list_item.type == V_LIST) {
-			childproc_panic(RV_VALUE_ERROR,
-				"a list cannot contain another list");
-		}
-
-		nl_append(result, list_item.number_value);
-	}
-	
-	return (Value){
-		.type = V_LIST,
-		.list_value = result
-	};
-}
-
-Value e_func_len(struct Expr* e) {
-
-	Value arg0 = try_eval_arg_as_type(e, 0, V_LIST);
-
-	int result = arg0.list_value.num_nums;
-
-	return (Value){
-		.type = V_NUM,
-		.number_value = num(result)
-	};
-}
-
-Value e_func_sum(struct Expr* e) {
-
-	Value arg0 = try_eval_arg_as_type(e, 0, V_LIST);
-	
-	Number result = num(0);
-
-	for (int i = 0; i < arg0.list_value.num_nums; i++) {
-
-		Number arg_value_n = arg0.list_value.nums[i];
-
-		result = num_add(result, arg_value_n);
-	}
-
-	return (Value){
-		.type = V_NUM,
-		.number_value = result
-	};
-}
-
-Value e_func_range(struct Expr* e) {
-
-	// TODO assert start and stop are not floats
-	// fix logic pls :)
-
-	Value arg0 = try_eval_arg_as_type(e, 0, V_NUM);
-	Value arg1 = try_eval_arg_as_type(e, 1, V_NUM);
-
-	int start = arg0.number_value.value;
-	int stop = arg1.number_value.value;
-
-	NumberList result = nl_new();
-
-	for (int i = start; i < stop; i++) {
-		Number n = num(i);
-		nl_append(result, n);
-	}
-
-	return (Value){
-		.type = V_LIST,
-		.list_value = result
-	};
-}
-
 Value e_func_if(struct Expr* e) {
 
 	Value arg0 = try_eval_arg_as_type(e, 0, V_NUM);
@@ -0,0 +1,322 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// scalar versions, also used for the tails of the vector loops
+
+static bool sum_scalar(const int64_t* a, int n, int64_t* out) {
+	int64_t s = 0;
+	for (int i = 0; i < n; i++) {
+		if (__builtin_add_overflow(s, a[i], &s)) {
+			return false;
+		}
+	}
+	*out = s;
+	return true;
+}
+
+static void minmax_scalar(const int64_t* a, int n,
+	int64_t* min, int64_t* max)
+{
+	int64_t lo = a[0];
+	int64_t hi = a[0];
+	for (int i = 1; i < n; i++) {
+		lo = (a[i] < lo) ? a[i] : lo;
+		hi = (a[i] > hi) ? a[i] : hi;
+	}
+	*min = lo;
+	*max = hi;
+}
+
+static int count_eq_scalar(const int64_t* a, int n, int64_t x) {
+	int c = 0;
+	for (int i = 0; i < n; i++) {
+		c += (a[i] == x);
+	}
+	return c;
+}
+
+static bool dot_scalar(const int64_t* a, const int64_t* b, int n,
+	int64_t* out)
+{
+	int64_t s = 0;
+	for (int i = 0; i < n; i++) {
+		int64_t p;
+		if (__builtin_mul_overflow(a[i], b[i], &p)
+		|| __builtin_add_overflow(s, p, &s)) {
+			return false;
+		}
+	}
+	*out = s;
+	return true;
+}
+
+// adds up the lanes of a vector sum and the tail that did not fill a
+// whole vector
+static bool sum_lanes(const int64_t* lanes, int num_lanes,
+	const int64_t* tail, int tail_len, int64_t* out)
+{
+	int64_t s;
+	if (!sum_scalar(tail, tail_len, &s)) {
+		return false;
+	}
+	for (int i = 0; i < num_lanes; i++) {
+		if (__builtin_add_overflow(s, lanes[i], &s)) {
+			return false;
+		}
+	}
+	*out = s;
+	return true;
+}
+
+#ifdef SIMD_X86
+
+// signed overflow of r = a + b shows up in the sign bit of
+// (a ^ r) & (b ^ r), those are or-ed together and checked once at the end
+// a lane that overflows only on the way is reported as overflow too, the
+// caller redoes that sum with gmp which gives the right result anyway
+
+__attribute__((target("sse2")))
+static bool sum_sse2(const int64_t* a, int n, int64_t* out) {
+	__m128i acc = _mm_setzero_si128();
+	__m128i ovf = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 2 <= n; i += 2) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i r = _mm_add_epi64(acc, x);
+		ovf = _mm_or_si128(ovf, _mm_and_si128(
+			_mm_xor_si128(acc, r),
+			_mm_xor_si128(x, r)));
+		acc = r;
+	}
+
+	if (_mm_movemask_pd(_mm_castsi128_pd(ovf)) != 0) {
+		return false;
+	}
+
+	int64_t lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, acc);
+	return sum_lanes(lanes, 2, a + i, n - i, out);
+}
+
+// sse2 has no 64 bit compare, the two 32 bit halves have to be equal
+__attribute__((target("sse2")))
+static int count_eq_sse2(const int64_t* a, int n, int64_t x) {
+	__m128i xv = _mm_set1_epi64x(x);
+	__m128i cnt = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 2 <= n; i += 2) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i eq32 = _mm_cmpeq_epi32(v, xv);
+		__m128i eq64 = _mm_and_si128(eq32,
+			_mm_shuffle_epi32(eq32, _MM_SHUFFLE(2, 3, 0, 1)));
+		// a match is -1
+		cnt = _mm_sub_epi64(cnt, eq64);
+	}
+
+	int64_t lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, cnt);
+	return lanes[0] + lanes[1] + count_eq_scalar(a + i, n - i, x);
+}
+
+__attribute__((target("avx2")))
+static bool sum_avx2(const int64_t* a, int n, int64_t* out) {
+	// two accumulators hide the latency of the adds
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+	__m256i ovf = _mm256_setzero_si256();
+
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i x0 = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i x1 = _mm256_loadu_si256((const __m256i*)(a + i + 4));
+		__m256i r0 = _mm256_add_epi64(acc0, x0);
+		__m256i r1 = _mm256_add_epi64(acc1, x1);
+		ovf = _mm256_or_si256(ovf, _mm256_and_si256(
+			_mm256_xor_si256(acc0, r0),
+			_mm256_xor_si256(x0, r0)));
+		ovf = _mm256_or_si256(ovf, _mm256_and_si256(
+			_mm256_xor_si256(acc1, r1),
+			_mm256_xor_si256(x1, r1)));
+		acc0 = r0;
+		acc1 = r1;
+	}
+
+	if (_mm256_movemask_pd(_mm256_castsi256_pd(ovf)) != 0) {
+		return false;
+	}
+
+	int64_t lanes[8];
+	_mm256_storeu_si256((__m256i*)lanes, acc0);
+	_mm256_storeu_si256((__m256i*)(lanes + 4), acc1);
+	return sum_lanes(lanes, 8, a + i, n - i, out);
+}
+
+__attribute__((target("avx2")))
+static void minmax_avx2(const int64_t* a, int n,
+	int64_t* min, int64_t* max)
+{
+	// two of each so the compare and blend chains can overlap
+	__m256i lo = _mm256_set1_epi64x(a[0]);
+	__m256i hi = lo;
+	__m256i lo1 = lo;
+	__m256i hi1 = lo;
+
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(a + i + 4));
+		lo = _mm256_blendv_epi8(lo, x, _mm256_cmpgt_epi64(lo, x));
+		hi = _mm256_blendv_epi8(hi, x, _mm256_cmpgt_epi64(x, hi));
+		lo1 = _mm256_blendv_epi8(lo1, y, _mm256_cmpgt_epi64(lo1, y));
+		hi1 = _mm256_blendv_epi8(hi1, y, _mm256_cmpgt_epi64(y, hi1));
+	}
+	lo = _mm256_blendv_epi8(lo, lo1, _mm256_cmpgt_epi64(lo, lo1));
+	hi = _mm256_blendv_epi8(hi, hi1, _mm256_cmpgt_epi64(hi1, hi));
+
+	int64_t lanes[8];
+	_mm256_storeu_si256((__m256i*)lanes, lo);
+	_mm256_storeu_si256((__m256i*)(lanes + 4), hi);
+
+	int64_t tail_lo = a[0];
+	int64_t tail_hi = a[0];
+	if (i < n) {
+		minmax_scalar(a + i, n - i, &tail_lo, &tail_hi);
+	}
+
+	for (int k = 0; k < 4; k++) {
+		tail_lo = (lanes[k] < tail_lo) ? lanes[k] : tail_lo;
+		tail_hi = (lanes[k + 4] > tail_hi) ? lanes[k + 4] : tail_hi;
+	}
+	*min = tail_lo;
+	*max = tail_hi;
+}
+
+__attribute__((target("avx2")))
+static int count_eq_avx2(const int64_t* a, int n, int64_t x) {
+	__m256i xv = _mm256_set1_epi64x(x);
+	__m256i cnt = _mm256_setzero_si256();
+
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(a + i));
+		cnt = _mm256_sub_epi64(cnt, _mm256_cmpeq_epi64(v, xv));
+	}
+
+	int64_t lanes[4];
+	_mm256_storeu_si256((__m256i*)lanes, cnt);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+		+ count_eq_scalar(a + i, n - i, x);
+}
+
+// avx2 can only multiply 32 bit lanes into 64 bit products, so the vector
+// loop checks on the way that every element fits in an int32_t and the
+// whole dot product is redone by the scalar kernel if one does not
+// the products can not overflow then, only their sum can
+__attribute__((target("avx2")))
+static bool dot_avx2(const int64_t* a, const int64_t* b, int n,
+	int64_t* out)
+{
+	// x fits in an int32_t if x + 2^31 fits in an uint32_t
+	__m256i bias = _mm256_set1_epi64x((int64_t)1 << 31);
+	__m256i wide = _mm256_setzero_si256();
+
+	__m256i acc = _mm256_setzero_si256();
+	__m256i ovf = _mm256_setzero_si256();
+
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+		wide = _mm256_or_si256(wide, _mm256_or_si256(
+			_mm256_srli_epi64(_mm256_add_epi64(x, bias), 32),
+			_mm256_srli_epi64(_mm256_add_epi64(y, bias), 32)));
+
+		__m256i p = _mm256_mul_epi32(x, y);
+		__m256i r = _mm256_add_epi64(acc, p);
+		ovf = _mm256_or_si256(ovf, _mm256_and_si256(
+			_mm256_xor_si256(acc, r),
+			_mm256_xor_si256(p, r)));
+		acc = r;
+	}
+
+	if (!_mm256_testz_si256(wide, wide)) {
+		return dot_scalar(a, b, n, out);
+	}
+
+	if (_mm256_movemask_pd(_mm256_castsi256_pd(ovf)) != 0) {
+		return false;
+	}
+
+	int64_t lanes[4];
+	_mm256_storeu_si256((__m256i*)lanes, acc);
+
+	int64_t tail;
+	if (!dot_scalar(a + i, b + i, n - i, &tail)) {
+		return false;
+	}
+	return sum_lanes(lanes, 4, &tail, 1, out);
+}
+
+#endif // SIMD_X86
+
+static SimdKernels SIMD_KERNELS[] = {
+	{ "scalar", sum_scalar, minmax_scalar, count_eq_scalar, dot_scalar },
+#ifdef SIMD_X86
+	// no 64 bit compares or multiplies before sse4.2 / avx2
+	{ "sse2", sum_sse2, minmax_scalar, count_eq_sse2, dot_scalar },
+	{ "avx2", sum_avx2, minmax_avx2, count_eq_avx2, dot_avx2 },
+#endif
+};
+
+SimdKernels simd = {
+	"scalar", sum_scalar, minmax_scalar, count_eq_scalar, dot_scalar
+};
+
+static bool simd_supported(char* name) {
+#ifdef SIMD_X86
+	__builtin_cpu_init();
+	if (strcmp(name, "sse2") == 0) {
+		return __builtin_cpu_supports("sse2");
+	}
+	if (strcmp(name, "avx2") == 0) {
+		return __builtin_cpu_supports("avx2");
+	}
+#endif
+	return strcmp(name, "scalar") == 0;
+}
+
+bool simd_select(char* name) {
+	if (!simd_supported(name)) {
+		return false;
+	}
+
+	int num_kernels = sizeof(SIMD_KERNELS) / sizeof(SIMD_KERNELS[0]);
+	for (int i = 0; i < num_kernels; i++) {
+		if (strcmp(SIMD_KERNELS[i].name, name) == 0) {
+			simd = SIMD_KERNELS[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+void simd_init() {
+	char* forced = getenv("PNC_SIMD");
+	if (forced != NULL && simd_select(forced)) {
+		return;
+	}
+
+	// best first
+	if (!simd_select("avx2") && !simd_select("sse2")) {
+		simd_select("scalar");
+	}
+}
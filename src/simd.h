@@ -0,0 +1,41 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// kernels over packed int64_t arrays (packed NumberLists)
+// every kernel has a scalar version, on x86 there are sse2 and avx2 ones
+// too and simd_init() picks the best one the cpu supports
+// the kernels that add or multiply return false if the result (or a
+// partial result) does not fit in an int64_t, then the caller has to
+// redo the work with gmp
+
+typedef struct {
+	// "scalar", "sse2" or "avx2"
+	char* name;
+
+	// *out = a[0] + ... + a[n - 1]
+	bool (*sum)(const int64_t* a, int n, int64_t* out);
+
+	// smallest and biggest element, n has to be at least 1
+	void (*minmax)(const int64_t* a, int n, int64_t* min, int64_t* max);
+
+	// number of elements equal to x
+	int (*count_eq)(const int64_t* a, int n, int64_t x);
+
+	// *out = a[0] * b[0] + ... + a[n - 1] * b[n - 1]
+	bool (*dot)(const int64_t* a, const int64_t* b, int n, int64_t* out);
+} SimdKernels;
+
+// the kernels in use, scalar ones until simd_init() runs
+extern SimdKernels simd;
+
+// picks the best kernels for this cpu
+// PNC_SIMD=scalar|sse2|avx2 in the environment picks them by name instead
+void simd_init();
+
+// switches to the kernels called name, false if this cpu cannot run them
+bool simd_select(char* name);
+
+#endif // SIMD_H
@@ -0,0 +1,55 @@
+#include "stats.h"
+
+static int hist_bucket(uint64_t v) {
+	if (v < (1 << HIST_SUB_BITS)) {
+		return v;
+	}
+
+	// the highest set bit picks the power of 2, the bits below it the
+	// bucket inside of it
+	int e = 63 - __builtin_clzll(v);
+	int sub = (v >> (e - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1);
+	return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+uint64_t hist_bucket_end(int i) {
+	if (i < (1 << HIST_SUB_BITS)) {
+		return i;
+	}
+
+	int e = (i >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+	uint64_t sub = i & ((1 << HIST_SUB_BITS) - 1);
+	uint64_t start = ((1 << HIST_SUB_BITS) + sub) << (e - HIST_SUB_BITS);
+	return start + ((uint64_t)1 << (e - HIST_SUB_BITS)) - 1;
+}
+
+void hist_add(LatencyHist* h, uint64_t v) {
+	h->count++;
+	h->sum += v;
+	if (v > h->max) {
+		h->max = v;
+	}
+	h->buckets[hist_bucket(v)]++;
+}
+
+uint64_t hist_percentile(const LatencyHist* h, double p) {
+	if (h->count == 0) {
+		return 0;
+	}
+
+	// rank of the value, 1 based
+	uint64_t rank = (uint64_t)(p / 100 * h->count + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	}
+
+	uint64_t seen = 0;
+	for (int i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			uint64_t end = hist_bucket_end(i);
+			return (end < h->max) ? end : h->max;
+		}
+	}
+	return h->max;
+}
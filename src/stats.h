@@ -0,0 +1,38 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+// counters for timings and other values that are collected over a whole
+// session, with percentiles
+
+// log scale histogram: every power of 2 is split into 8 buckets, so a
+// percentile is off by at most 1/8 of the value, values below 8 are exact
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+} LatencyHist;
+
+void hist_add(LatencyHist* h, uint64_t v);
+
+// biggest value that goes into bucket i
+uint64_t hist_bucket_end(int i);
+
+// the value p percent of the values are at or below (0 <= p <= 100),
+// rounded up to the end of its bucket, 0 if h is empty
+uint64_t hist_percentile(const LatencyHist* h, double p);
+
+// monotonic clock in nanoseconds
+static inline uint64_t clock_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif // STATS_H
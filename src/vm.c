@@ -0,0 +1,179 @@
+#include "pnc.h"
+
+// bytecode compiler and the vm that runs it
+
+static void chunk_emit(Chunk* c, int32_t word) {
+	arena_grow(c->code, c->code_len, c->code_cap, 64);
+	c->code[c->code_len++] = word;
+}
+
+static int chunk_add_num(Chunk* c, Number n) {
+	arena_grow(c->nums, c->num_nums, c->nums_cap, 16);
+	c->nums[c->num_nums] = n;
+	return c->num_nums++;
+}
+
+// an expr that still has to be compiled
+typedef struct {
+	Expr* e;
+
+	// false: visit e for the first time
+	// true: all arguments of the call e have been compiled, emit the call
+	bool args_done;
+} CompileFrame;
+
+Chunk compile(Expr* root) {
+	Chunk c = {0};
+
+	CompileFrame* todo = NULL;
+	int todo_len = 0;
+	int todo_cap = 0;
+
+	// stack depth of the vm after the code emitted so far
+	int sp = 0;
+
+	arena_grow(todo, todo_len, todo_cap, 16);
+	todo[todo_len++] = (CompileFrame){ .e = root };
+
+	while (todo_len > 0) {
+		CompileFrame f = todo[--todo_len];
+		Expr* e = f.e;
+
+		if (f.args_done) {
+			chunk_emit(&c, OP_CALL);
+			chunk_emit(&c, e->funccall.func_index);
+			chunk_emit(&c, e->funccall.num_args_passed);
+			sp = sp - e->funccall.num_args_passed + 1;
+			c.max_stack = max(c.max_stack, sp);
+			continue;
+		}
+
+		if (e->type == E_NUMBER) {
+			chunk_emit(&c, OP_PUSH_NUM);
+			chunk_emit(&c, chunk_add_num(&c, e->number));
+			sp++;
+		}
+
+		else if (e->type == E_IDENT) {
+			if (e->ident.len == 0) {
+				eval_panic(RV_OTHER_ERROR,
+					"something bad happened on line %d", __LINE__);
+			}
+
+			if (e->ident.name[0] != '#') {
+				eval_panic(RV_NAME_ERROR, "'%.*s' is unknown",
+					e->ident.len,
+					e->ident.name);
+			}
+
+			int i = rt_find_constant(e->ident.name, e->ident.len);
+			if (i == -1) {
+				eval_panic(RV_NAME_ERROR, "undefined constant %.*s",
+					e->ident.len,
+					e->ident.name);
+			}
+
+			chunk_emit(&c, OP_PUSH_CONST);
+			chunk_emit(&c, i);
+			sp++;
+		}
+
+		else if (e->type == E_FUNCCALL) {
+			// checked before the arguments, same order as eval()
+			assert_funccall_arg_count_correct(e);
+
+			arena_grow(todo, todo_len, todo_cap, 16);
+			todo[todo_len++] = (CompileFrame){ .e = e, .args_done = true };
+
+			// pushed backwards so the first argument is compiled first
+			for (int i = e->funccall.num_args_passed - 1; i >= 0; i--) {
+				arena_grow(todo, todo_len, todo_cap, 16);
+				todo[todo_len++] = (CompileFrame){ .e = e->funccall.args[i] };
+			}
+		}
+
+		else {
+			eval_panic(RV_OTHER_ERROR,
+				"something bad happened on line %d", __LINE__);
+		}
+
+		c.max_stack = max(c.max_stack, sp);
+	}
+
+	return c;
+}
+
+Value vm_run(Chunk* c) {
+	heap_grow(ctx.vm_stack, c->max_stack, ctx.vm_stack_cap, 64);
+
+	Value* stack = ctx.vm_stack;
+	int sp = 0;
+
+	int32_t* ip = c->code;
+	int32_t* end = c->code + c->code_len;
+
+	while (ip < end) {
+		switch (*ip++) {
+
+			case OP_PUSH_NUM:
+				stack[sp++] = (Value){
+					.type = V_NUM,
+					.number_value = c->nums[*ip++]
+				};
+				break;
+
+			case OP_PUSH_CONST:
+				stack[sp++] = rt_constant_value(*ip++);
+				break;
+
+			case OP_CALL: {
+				E_FuncData* fd = &RT_BUILTIN_FUNCTIONS.fns[ip[0]];
+				int argc = ip[1];
+				ip += 2;
+
+				Value* args = &stack[sp - argc];
+				for (int i = 0; i < argc; i++) {
+					assert_arg_type_correct(fd, i, args[i]);
+				}
+
+				Value result = call_builtin(fd, args, argc);
+				mem_check();
+				sp -= argc;
+				stack[sp++] = result;
+				break;
+			}
+
+			default:
+				eval_panic(RV_OTHER_ERROR,
+					"something bad happened on line %d", __LINE__);
+		}
+	}
+
+	return stack[0];
+}
+
+void chunk_print(Chunk* c) {
+	int i = 0;
+	while (i < c->code_len) {
+		int32_t op = c->code[i];
+		printf("\t[%d] ", i);
+
+		if (op == OP_PUSH_NUM) {
+			printf("OP_PUSH_NUM %d (", c->code[i + 1]);
+			num_print(c->nums[c->code[i + 1]]);
+			printf(")\n");
+		} else if (op == OP_PUSH_CONST) {
+			printf("OP_PUSH_CONST %s\n",
+				RT_CONSTANT_VARS.vars[c->code[i + 1]].name);
+		} else if (op == OP_CALL) {
+			E_FuncData* fd = &RT_BUILTIN_FUNCTIONS.fns[c->code[i + 1]];
+			printf("OP_CALL '%.*s' %d\n",
+				fd->name_len, fd->name, c->code[i + 2]);
+		} else {
+			printf("OP_UNKNOWN %d\n", op);
+			return;
+		}
+
+		i += 1 + op_num_operands(op);
+	}
+}
@@ -0,0 +1,937 @@
+#include "../src/pnc.h"
+
+// tests that run the pipeline directly, without the repl
+// usage: build/test
+// exits with 1 if anything failed
+
+static int failures = 0;
+
+#define check(cond, name) \
+	do { \
+		if (cond) { \
+			printf("ok   %s\n", (name)); \
+		} else { \
+			printf("FAIL %s\n", (name)); \
+			failures++; \
+		} \
+	} while(0)
+
+// "(+ 1 (+ 1 (+ 1 ... 1)))" with depth nested calls, evaluates to depth + 1
+static char* gen_deep(int depth) {
+	char* s = malloc(depth * 6 + 2);
+	char* p = s;
+	for (int i = 0; i < depth; i++) {
+		memcpy(p, "(+ 1 ", 5);
+		p += 5;
+	}
+	*p++ = '1';
+	memset(p, ')', depth);
+	p += depth;
+	*p = '\0';
+	return s;
+}
+
+static bool value_is_int(Value v, unsigned long n) {
+	mpz_t view;
+	mp_limb_t limb;
+	return v.type == V_NUM
+		&& v.number_value.type == NUM_INTEGER
+		&& mpz_cmp_ui(num_z(&v.number_value, view, &limb), n) == 0;
+}
+
+// evaluates prog and compares the printed integer with want
+static bool eval_prints_int(char* prog, char* want) {
+	Expr* e = parse_str(prog);
+	Chunk c = compile(e);
+	Value v = vm_run(&c);
+
+	bool ok = v.type == V_NUM && v.number_value.type == NUM_INTEGER;
+	if (ok) {
+		mpz_t view;
+		mp_limb_t limb;
+		char* got = mpz_get_str(NULL, 10,
+			num_z(&v.number_value, view, &limb));
+		ok = strcmp(got, want) == 0;
+		free(got);
+	}
+
+	arena_reset(&ctx.arena);
+	return ok;
+}
+
+// evaluates prog and compares what it prints with want
+static bool eval_prints(char* prog, char* want) {
+	Expr* e = parse_str(prog);
+	Chunk c = compile(e);
+	dstr_clear(ctx.out);
+	print_value(vm_run(&c));
+
+	bool ok = strcmp(ctx.out.data, want) == 0;
+	if (!ok) {
+		printf("     %s printed %s\n", prog, ctx.out.data);
+	}
+
+	dstr_clear(ctx.out);
+	arena_reset(&ctx.arena);
+	return ok;
+}
+
+// every step has to survive nesting far deeper than the c stack allows
+static void test_deep_nesting() {
+	int depth = 1000000;
+	char* prog = gen_deep(depth);
+
+	Expr* e = parse_str(prog);
+	Chunk c = compile(e);
+	check(value_is_int(vm_run(&c), depth + 1), "deep nesting: vm");
+	check(value_is_int(eval(e), depth + 1), "deep nesting: eval");
+	arena_reset(&ctx.arena);
+
+	Expr* e2 = parse(make_ast(tokenize(prog)));
+	check(value_is_int(eval(e2), depth + 1),
+		"deep nesting: tokenize, make_ast, parse");
+	arena_reset(&ctx.arena);
+
+	free(prog);
+}
+
+// small integers have to promote to gmp on overflow and come back after
+static void test_small_int_overflow() {
+	check(eval_prints_int("(+ 9223372036854775807 1)",
+		"9223372036854775808"), "small int: overflow promotes");
+	check(eval_prints_int("(+ -9223372036854775808 -1)",
+		"-9223372036854775809"), "small int: negative overflow promotes");
+	check(eval_prints_int("(+ 9223372036854775808 -1)",
+		"9223372036854775807"), "small int: big result demotes");
+	check(eval_prints_int("(+ 100000000000000000000 -100000000000000000000)",
+		"0"), "small int: big to zero");
+
+	Expr* e = parse_str("(+ 9223372036854775807 -9223372036854775807)");
+	Chunk c = compile(e);
+	Value v = vm_run(&c);
+	check(v.number_value.is_small && v.number_value.small_value == 0,
+		"small int: result stays small");
+	arena_reset(&ctx.arena);
+}
+
+// during an evaluation gmp limbs come from the arena and go with it
+static void test_gmp_arena() {
+	ctx.gmp_stats = (GmpAllocStats){0};
+	ctx.gmp_use_arena = true;
+
+	Expr* e = parse_str("(+ 100000000000000000000000 (+ 1/3 1))");
+	Chunk c = compile(e);
+	Value v = vm_run(&c);
+
+	mpz_ptr num = mpq_numref(v.number_value.rational_value);
+	check(v.number_value.type == NUM_RATIONAL
+		&& arena_owns(&ctx.arena, num->_mp_d),
+		"gmp arena: result limbs are in the arena");
+	check(ctx.gmp_stats.allocs > 0 && ctx.gmp_stats.bytes > 0,
+		"gmp arena: allocations are counted");
+
+	eval_cleanup();
+	check(!ctx.gmp_use_arena, "gmp arena: heap again after cleanup");
+
+	Number n;
+	num_from_str("100000000000000000000000", 24, &n);
+	check(!arena_owns(&ctx.arena, n.integer_value->_mp_d),
+		"gmp arena: heap limbs outside of an evaluation");
+	num_clear(n);
+}
+
+static Number lit(char* s) {
+	Number n;
+	if (!num_from_str(s, strlen(s), &n)) {
+		printf("FAIL bad literal %s\n", s);
+		exit(1);
+	}
+	return n;
+}
+
+static bool num_same(Number a, Number b) {
+	mpz_t va, vb;
+	mp_limb_t la, lb;
+
+	if (a.type != b.type) {
+		return false;
+	}
+	switch (a.type) {
+		case NUM_INTEGER:
+			return a.is_small == b.is_small
+				&& mpz_cmp(num_z(&a, va, &la), num_z(&b, vb, &lb)) == 0;
+		case NUM_RATIONAL:
+			return mpq_equal(a.rational_value, b.rational_value);
+		case NUM_REAL:
+			return mpfr_cmp(a.real_value, b.real_value) == 0;
+	}
+	return false;
+}
+
+// num_add_into() has to agree with num_add() for every pair of types
+static void test_add_into() {
+	char* lits[] = {
+		"7", "-3", "9223372036854775807", "123456789012345678901234567890",
+		"1/3", "-5/7", "2.5", "0.1",
+	};
+	int n = sizeof(lits) / sizeof(lits[0]);
+
+	bool same = true;
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) {
+			Number a = lit(lits[i]);
+			Number b = lit(lits[j]);
+
+			Number want = num_add(a, b);
+			Number acc = num_small(0);
+			num_set(&acc, &a);
+			num_add_into(&acc, &b);
+
+			if (!num_same(acc, want)) {
+				printf("     %s + %s differs\n", lits[i], lits[j]);
+				same = false;
+			}
+
+			num_clear(a);
+			num_clear(b);
+			num_clear(want);
+			num_clear(acc);
+		}
+	}
+	check(same, "add_into: same results as num_add");
+
+	// 10 * 3/2 * 2 * 2.5
+	Number acc = num_small(10);
+	Number x = lit("3/2");
+	num_mul_into(&acc, &x);
+	check(acc.type == NUM_RATIONAL
+		&& mpq_cmp_si(acc.rational_value, 15, 1) == 0, "mul_into: Z * Q");
+	num_clear(x);
+	x = num_small(2);
+	num_mul_into(&acc, &x);
+	x = lit("2.5");
+	num_mul_into(&acc, &x);
+	check(acc.type == NUM_REAL && mpfr_cmp_si(acc.real_value, 75) == 0,
+		"mul_into: Q * Z * R");
+	num_clear(x);
+	num_clear(acc);
+
+	// once acc has room, folding allocates nothing
+	Number big = lit("123456789012345678901234567890");
+	Number third = lit("1/3");
+	Number half = lit("0.5");
+	Number accs[] = { lit("0"), lit("0/1"), lit("0.0") };
+	Number* xs[] = { &big, &third, &half };
+	char* names[] = {
+		"add_into: no allocations in steady state (integer)",
+		"add_into: no allocations in steady state (rational)",
+		"add_into: no allocations in steady state (real)",
+	};
+	for (int i = 0; i < 3; i++) {
+		num_add_into(&accs[i], &big);
+		num_add_into(&accs[i], xs[i]);
+		size_t before = ctx.gmp_stats.allocs + ctx.gmp_stats.reallocs;
+		for (int k = 0; k < 1000; k++) {
+			num_add_into(&accs[i], (i == 1) ? &big : xs[i]);
+		}
+		check(ctx.gmp_stats.allocs + ctx.gmp_stats.reallocs == before,
+			names[i]);
+		num_clear(accs[i]);
+	}
+	num_clear(big);
+	num_clear(third);
+	num_clear(half);
+}
+
+// len and sum of a range use closed forms, they have to agree with
+// walking the range one number at a time
+static void test_range() {
+	char* progs[] = {
+		"(range 0 10)", "(range 10 0 -3)", "(range -7 8 4)", "(range 5 5)",
+		"(range 5 1)", "(range 1 5 -1)",
+		"(range 9223372036854775800 9223372036854775815 2)",
+	};
+
+	bool same = true;
+	for (size_t i = 0; i < sizeof(progs) / sizeof(progs[0]); i++) {
+		Expr* e = parse_str(progs[i]);
+		Chunk c = compile(e);
+		Value r = vm_run(&c);
+
+		Number len = num_small(0);
+		Number sum = num_small(0);
+		Number one = num_small(1);
+		Number x;
+		ListIter it = list_iter_new(r);
+		while (list_iter_next(&it, &x)) {
+			num_add_into(&len, &one);
+			num_add_into(&sum, &x);
+		}
+
+		Number want_len = e_func_len(&r, 1).number_value;
+		Number want_sum = e_func_sum(&r, 1).number_value;
+		if (num_integer_cmp(&len, &want_len) != 0
+		|| num_integer_cmp(&sum, &want_sum) != 0) {
+			printf("     %s differs\n", progs[i]);
+			same = false;
+		}
+
+		arena_reset(&ctx.arena);
+	}
+	check(same, "range: closed forms match iteration");
+
+	check(eval_prints_int("(sum (range 0 100000000))", "4999999950000000"),
+		"range: sum of a huge range");
+	check(eval_prints_int("(len (range 0 1000000000000000000000 3))",
+		"333333333333333333334"), "range: len past int64");
+}
+
+// fib answers from its memo by stepping forwards and backwards, that has
+// to give the same numbers as computing them directly
+static void test_fib_memo() {
+	unsigned long ns[] = { 30000, 30000, 30700, 29500, 29999, 200000, 5 };
+
+	bool same = true;
+	for (size_t i = 0; i < sizeof(ns) / sizeof(ns[0]); i++) {
+		Value arg = { .type = V_NUM, .number_value = num_small(ns[i]) };
+		Value v = e_func_fib(&arg, 1);
+
+		mpz_t want, view;
+		mp_limb_t limb;
+		mpz_init(want);
+		mpz_fib_ui(want, ns[i]);
+		if (mpz_cmp(num_z(&v.number_value, view, &limb), want) != 0) {
+			printf("     fib %lu differs\n", ns[i]);
+			same = false;
+		}
+		mpz_clear(want);
+		num_clear(v.number_value);
+	}
+	check(same, "fib: memo gives the same results as mpz_fib_ui");
+
+	fib_memo_clear();
+}
+
+// lists stay packed while they only hold small integers of one base
+static void test_list_layout() {
+	NumberList nl = nl_new();
+	for (int i = 0; i < 1000; i++) {
+		nl_append(&nl, num_small(i));
+	}
+	check(!nl.unpacked && nl.num_nums == 1000 && nl.cap < 2000,
+		"list: small integers stay packed");
+
+	Number big;
+	num_from_str("100000000000000000000", 21, &big);
+	nl_append(&nl, big);
+
+	bool same = nl.unpacked && nl.num_nums == 1001;
+	for (int i = 0; same && i < 1000; i++) {
+		Number n = nl_get(nl, i);
+		same = n.is_small && n.small_value == i;
+	}
+	check(same, "list: unpacking keeps every number");
+
+	check(eval_prints_int("(sum (list 9223372036854775807 1 -1 2))",
+		"9223372036854775809"), "list: packed sum overflows into gmp");
+	check(eval_prints_int("(sum (list 1 100000000000000000000 2))",
+		"100000000000000000003"), "list: generic sum");
+
+	arena_reset(&ctx.arena);
+}
+
+// uniform in [-scale, scale]
+static int64_t rand_in(int64_t scale) {
+	return (int64_t)((rand() / (double)RAND_MAX - 0.5) * 2 * scale);
+}
+
+// every kernel set has to give the same results as the scalar one,
+// including the overflow checks
+static void test_simd_kernels() {
+	int n = 1003;
+	int64_t* a = malloc(sizeof(int64_t) * n);
+	int64_t* b = malloc(sizeof(int64_t) * n);
+
+	char* names[] = { "sse2", "avx2" };
+	for (size_t k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+		bool same = true;
+
+		for (int round = 0; round < 200; round++) {
+			// small values, values near the int32 limit and values that
+			// overflow when added up
+			int64_t scale = (round % 3 == 0) ? 1000
+				: (round % 3 == 1) ? INT32_MAX
+				: INT64_MAX / 64;
+			int len = round * 5 % n;
+			for (int i = 0; i < len; i++) {
+				a[i] = rand_in(scale);
+				b[i] = rand_in(scale);
+			}
+			int64_t x = (len > 0) ? a[len / 2] : 0;
+
+			int64_t s1 = 0, s2 = 0, d1 = 0, d2 = 0;
+			int64_t lo1 = 0, lo2 = 0, hi1 = 0, hi2 = 0;
+
+			simd_select("scalar");
+			bool sum_ok1 = simd.sum(a, len, &s1);
+			bool dot_ok1 = simd.dot(a, b, len, &d1);
+			int c1 = simd.count_eq(a, len, x);
+			if (len > 0) {
+				simd.minmax(a, len, &lo1, &hi1);
+			}
+
+			if (!simd_select(names[k])) {
+				break;
+			}
+			bool sum_ok2 = simd.sum(a, len, &s2);
+			bool dot_ok2 = simd.dot(a, b, len, &d2);
+			int c2 = simd.count_eq(a, len, x);
+			if (len > 0) {
+				simd.minmax(a, len, &lo2, &hi2);
+			}
+
+			// a vector sum can report an overflow the scalar one does not
+			// see (a lane overflows on the way), never the other way around
+			same = same
+				&& (!sum_ok2 || (sum_ok1 && s1 == s2))
+				&& (!dot_ok2 || (dot_ok1 && d1 == d2))
+				&& (sum_ok2 || round % 3 == 2 || !sum_ok1)
+				&& c1 == c2 && lo1 == lo2 && hi1 == hi2;
+		}
+
+		char name[64];
+		sprintf(name, "simd: %s kernels match scalar", names[k]);
+		check(same, name);
+	}
+
+	simd_init();
+	free(a);
+	free(b);
+}
+
+// sum and prod of big lists go through the thread pool, the result has to
+// be exactly what a left fold gives, with any number of threads
+static void test_tree_reduce() {
+	int saved = pool_size();
+
+	// big integers, small ones and rationals, so the partial results of
+	// the chunks have different types
+	NumberList nl = nl_new();
+	char buf[64];
+	for (int i = 1; i <= 5000; i++) {
+		if (i % 7 == 0) {
+			snprintf(buf, sizeof(buf), "%d/%d", i + 1, i);
+		} else if (i % 3 == 0) {
+			snprintf(buf, sizeof(buf), "%d00000000000000000000", i);
+		} else {
+			snprintf(buf, sizeof(buf), "%d", i);
+		}
+		nl_append(&nl, lit(buf));
+	}
+	Value list = { .type = V_LIST, .list_value = nl };
+
+	Number want_sum = num_small(0);
+	Number want_prod = num_small(1);
+	for (int i = 0; i < nl.num_nums; i++) {
+		num_add_into(&want_sum, &nl.nums[i]);
+		num_mul_into(&want_prod, &nl.nums[i]);
+	}
+
+	int threads[] = { 1, 2, 3, 8 };
+	bool same = true;
+	for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		pool_init(threads[i]);
+		Number sum = e_func_sum(&list, 1).number_value;
+		Number prod = e_func_prod(&list, 1).number_value;
+		if (!num_same(sum, want_sum) || !num_same(prod, want_prod)) {
+			printf("     %d threads differ\n", threads[i]);
+			same = false;
+		}
+	}
+	check(same, "tree reduce: same results as a left fold");
+
+	// hex numbers with a rational in between, so the list is not packed
+	NumberList hex = nl_new();
+	for (int i = 1; i <= 5000; i++) {
+		snprintf(buf, sizeof(buf), (i % 5 == 0) ? "0x%x/3" : "0x%x", i);
+		nl_append(&hex, lit(buf));
+	}
+	Value hex_list = { .type = V_LIST, .list_value = hex };
+	bool hex_base = true;
+	for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		pool_init(threads[i]);
+		hex_base = hex_base
+			&& e_func_sum(&hex_list, 1).number_value.base == 16
+			&& e_func_prod(&hex_list, 1).number_value.base == 16;
+	}
+	check(hex_base, "tree reduce: base of the first number");
+
+	pool_init(4);
+	char* fact40 = "815915283247897734345611269596115894272000000000";
+	check(eval_prints_int("(prod (range 1 41))", fact40),
+		"tree reduce: prod of a range");
+	check(eval_prints_int("(prod (range 40 0 -1))", fact40),
+		"tree reduce: prod of a range going down");
+
+	pool_init(saved);
+	num_clear(want_sum);
+	num_clear(want_prod);
+	arena_reset(&ctx.arena);
+}
+
+// sum keeps integers, rationals and reals apart until the end, for exact
+// numbers that has to give what a left fold gives
+static void test_bucketed_sum() {
+	// repeating denominators, ones that divide each other and primes, so
+	// every way num_sum_add() handles a rational gets used
+	char* dens[] = { "3", "6", "12", "7", "11", "1000000000000000000000" };
+	int num_dens = sizeof(dens) / sizeof(dens[0]);
+
+	srand(16);
+	bool same = true;
+	char buf[96];
+	for (int round = 0; round < 50; round++) {
+		NumberList nl = nl_new();
+		int n = 1 + rand() % 400;
+		for (int i = 0; i < n; i++) {
+			int kind = rand() % 4;
+			int64_t x = rand_in(INT64_MAX / 2);
+			if (kind == 0) {
+				snprintf(buf, sizeof(buf), "%" PRId64, x);
+			} else if (kind == 1) {
+				snprintf(buf, sizeof(buf), "%" PRId64 "000000000000", x);
+			} else {
+				snprintf(buf, sizeof(buf), "%" PRId64 "/%s",
+					x % 1000, dens[rand() % num_dens]);
+			}
+			nl_append(&nl, lit(buf));
+		}
+
+		Number want = num_small(0);
+		for (int i = 0; i < nl.num_nums; i++) {
+			Number x = nl_get(nl, i);
+			num_add_into(&want, &x);
+		}
+
+		Value list = { .type = V_LIST, .list_value = nl };
+		if (!num_same(e_func_sum(&list, 1).number_value, want)) {
+			printf("     round %d differs\n", round);
+			same = false;
+		}
+		arena_reset(&ctx.arena);
+	}
+	check(same, "bucketed sum: exact numbers match a left fold");
+
+	// the integers cancel out before the real is added
+	Expr* e = parse_str(
+		"(sum (list 0.5 100000000000000000000 -100000000000000000000))");
+	Chunk c = compile(e);
+	Value v = vm_run(&c);
+	check(v.number_value.type == NUM_REAL
+		&& mpfr_cmp_d(v.number_value.real_value, 0.5) == 0,
+		"bucketed sum: exact part is rounded only once");
+	arena_reset(&ctx.arena);
+
+	check(eval_prints("(sum (list 0x10 0x20 1/2))", "0x61/2")
+		&& eval_prints("(sum (list 0b11 1/2 7))", "0b10101/10")
+		&& eval_prints("(sum (list 0x10 0x20 1.5))",
+			"0x3.1800000000000@1")
+		&& eval_prints("(sum (list 1/2 0x10))", "33/2"),
+		"bucketed sum: base of the first number");
+}
+
+// #pi and #e are computed once per precision and then reused
+static void test_constants() {
+	mpfr_prec_t saved = mpfr_get_default_prec();
+
+	int pi = rt_find_constant("#pi", 3);
+	rt_set_prec("100000");
+	Value a = rt_constant_value(pi);
+	Value b = rt_constant_value(pi);
+
+	mpfr_t want;
+	mpfr_init(want);
+	mpfr_const_pi(want, MPFR_RNDN);
+	check(mpfr_get_prec(a.number_value.real_value) == 100000
+		&& mpfr_cmp(a.number_value.real_value, want) == 0,
+		"constants: #pi at the current precision");
+	mpfr_clear(want);
+
+	// same limbs, not just the same value
+	check(mpfr_custom_get_significand(a.number_value.real_value)
+		== mpfr_custom_get_significand(b.number_value.real_value),
+		"constants: #pi is computed once");
+
+	rt_set_prec("53");
+	Value c = rt_constant_value(pi);
+	check(mpfr_get_prec(c.number_value.real_value) == 53
+		&& mpfr_get_d(c.number_value.real_value, MPFR_RNDN) == M_PI,
+		"constants: other precision, other value");
+
+	rt_set_prec("100000");
+	Value d = rt_constant_value(pi);
+	check(mpfr_custom_get_significand(a.number_value.real_value)
+		== mpfr_custom_get_significand(d.number_value.real_value),
+		"constants: going back to a precision reuses its value");
+
+	check(!rt_set_prec("0") && !rt_set_prec("12x") && !rt_set_prec(""),
+		"constants: bad precisions are rejected");
+
+	mpfr_set_default_prec(saved);
+	rt_constant_cache_clear();
+}
+
+// literals that fit are read straight into small integers, everything at
+// the edges of that has to come out the same as through gmp
+static void test_literals() {
+	Number n;
+	check(num_from_str("9223372036854775807", 19, &n)
+		&& n.is_small && n.small_value == INT64_MAX
+		&& num_from_str("-9223372036854775808", 20, &n)
+		&& n.is_small && n.small_value == INT64_MIN
+		&& num_from_str("0x7fffffffffffffff", 18, &n)
+		&& n.is_small && n.small_value == INT64_MAX && n.base == 16,
+		"literals: int64 limits are small");
+
+	mpz_t want;
+	mpz_init_set_str(want, "9223372036854775808", 10);
+	check(num_from_str("9223372036854775808", 19, &n)
+		&& !n.is_small && mpz_cmp(n.integer_value, want) == 0,
+		"literals: one past the limit goes to gmp");
+	num_clear(n);
+	mpz_clear(want);
+
+	mpq_t q;
+	mpq_init(q);
+	mpq_set_si(q, -3, 2);
+	check(num_from_str("6/-4", 4, &n) && n.type == NUM_RATIONAL
+		&& mpq_equal(n.rational_value, q),
+		"literals: rationals are canonical");
+	num_clear(n);
+	check(num_from_str("-12/8", 5, &n) && n.type == NUM_RATIONAL
+		&& mpq_equal(n.rational_value, q),
+		"literals: small rationals are canonical");
+	num_clear(n);
+	mpq_clear(q);
+
+	char* bad[] = { "5/0", "5/", "/5", "-", "1//2", "1.2.3", "1.5/2", "0x",
+		"12a", "0b102" };
+	bool rejected = true;
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		if (num_from_str(bad[i], strlen(bad[i]), &n)) {
+			printf("     %s was accepted\n", bad[i]);
+			rejected = false;
+		}
+	}
+	check(rejected, "literals: malformed ones are rejected");
+}
+
+// results are rendered into ctx.out, in the same format the stdio
+// functions of gmp and mpfr use
+static void test_print() {
+	Expr* e = parse_str("(list 1 -9223372036854775808 0x1f 6/8 0b101 "
+		"100000000000000000000 0x100000000000000000000)");
+	Chunk c = compile(e);
+	dstr_clear(ctx.out);
+	print_value(vm_run(&c));
+	check(strcmp(ctx.out.data, "(list 1 -9223372036854775808 0x1f 3/4 0b101 "
+		"100000000000000000000 0x100000000000000000000)") == 0,
+		"print: integers and rationals");
+	arena_reset(&ctx.arena);
+
+	char* want = NULL;
+	size_t want_len;
+	FILE* f = open_memstream(&want, &want_len);
+	Number reals[3];
+	num_from_str("-2.5", 4, &reals[0]);
+	num_from_str("0x1.8", 5, &reals[1]);
+	reals[2] = rt_constant_value(rt_find_constant("#pi", 3)).number_value;
+	dstr_clear(ctx.out);
+	for (int i = 0; i < 3; i++) {
+		fputs((reals[i].base == 16) ? "0x" : "", f);
+		mpfr_out_str(f, reals[i].base, 0, reals[i].real_value, MPFR_RNDN);
+		fputc(' ', f);
+		num_write(&ctx.out, reals[i]);
+		dstr_append_char(ctx.out, ' ');
+	}
+	fclose(f);
+	check(strcmp(ctx.out.data, want) == 0, "print: reals like mpfr_out_str");
+	free(want);
+
+	num_clear(reals[0]);
+	num_clear(reals[1]);
+	rt_constant_cache_clear();
+	dstr_clear(ctx.out);
+}
+
+static void test_timing() {
+	LatencyHist h = {0};
+	for (int i = 1; i <= 1000; i++) {
+		hist_add(&h, i * 1000);
+	}
+	check(h.count == 1000 && h.max == 1000000, "timing: hist counts");
+
+	// within a bucket, 1/8 of the value
+	bool close = true;
+	double ps[] = { 1, 50, 90, 99, 100 };
+	for (int i = 0; i < 5; i++) {
+		double want = ps[i] * 10000;
+		double got = hist_percentile(&h, ps[i]);
+		close = close && got >= want && got <= want * 1.125;
+	}
+	check(close, "timing: percentiles");
+
+	LatencyHist small = {0};
+	hist_add(&small, 3);
+	hist_add(&small, 5);
+	check(hist_percentile(&small, 50) == 3 && hist_percentile(&small, 100) == 5,
+		"timing: small values are exact");
+
+	// eval_pnc_expr() sets its own jump target
+	jmp_buf env;
+	memcpy(env, ctx.eval_env, sizeof(jmp_buf));
+
+	ctx.timing.enabled = true;
+	eval_pnc_expr("(+ 1 2)");
+	eval_pnc_expr("(undefined 1)");
+	ctx.timing.enabled = false;
+	eval_pnc_expr("(+ 1 2)");
+
+	LatencyHist* hists = ctx.timing.hists;
+	check(hists[PHASE_TOTAL].count == 2
+		&& hists[PHASE_PARSE].count == 2
+		&& hists[PHASE_EVAL].count == 1
+		&& hists[PHASE_PRINT].count == 1,
+		"timing: phases of timed evaluations");
+	check(hists[PHASE_TOTAL].sum >= hists[PHASE_PARSE].sum
+		+ hists[PHASE_EVAL].sum, "timing: total covers the phases");
+
+	eval_pnc_expr(":stats reset");
+	check(hists[PHASE_TOTAL].count == 0, "timing: reset");
+
+	memcpy(ctx.eval_env, env, sizeof(jmp_buf));
+}
+
+static void test_profile() {
+	check(profile_init("/dev/null"), "profile: init");
+
+	eval_prints_int("(+ 1 2)", "3");
+	eval_prints_int("(+ 100000000000000000000 1)", "100000000000000000001");
+	eval_prints_int("(sum (list 1 2))", "3");
+
+	BuiltinProfile* add = &ctx.profile[rt_find_func("+", 1)];
+	check(add->calls == 2 && add->latency.count == 2
+		&& add->arg_mix[ARG_SMALL] == 1
+		&& add->arg_mix[ARG_SMALL | ARG_BIG] == 1,
+		"profile: calls and argument types");
+	check(ctx.profile[rt_find_func("sum", 3)].arg_mix[ARG_LIST] == 1,
+		"profile: lists");
+
+	char* json = NULL;
+	size_t json_len;
+	FILE* f = open_memstream(&json, &json_len);
+	profile_write(f);
+	fclose(f);
+	check(strstr(json, "{\"name\": \"+\", \"calls\": 2,") != NULL
+		&& strstr(json, "\"arg_mix\": {\"S\": 1, \"SZ\": 1}") != NULL,
+		"profile: json");
+	free(json);
+
+	profile_free();
+	check(ctx.profile == NULL, "profile: free");
+}
+
+static jmp_buf over_limit_env;
+
+static void over_limit(Arena* a, size_t size) {
+	(void)a;
+	(void)size;
+	longjmp(over_limit_env, 1);
+}
+
+static void test_mem() {
+	Arena a = arena_new();
+	char* p = arena_alloc(&a, 100);
+	arena_alloc(&a, 100);
+	check(a.used == a.total && a.used >= 200, "mem: arena counts");
+
+	char* q = arena_alloc(&a, 1000);
+	arena_pop(&a, q);
+	size_t peak = a.peak;
+	check(a.used + 1000 <= peak && a.total == peak, "mem: pop and peak");
+
+	q = arena_alloc(&a, 10);
+	q = arena_realloc(&a, q, 10, 5000);
+	check(a.used == peak - 1000 + 5000 && a.peak == a.used,
+		"mem: realloc in place");
+	(void)p;
+
+	a.limit = ARENA_CHUNK_SIZE + 1000;
+	a.over_limit = over_limit;
+	bool stopped = false;
+	if (setjmp(over_limit_env) == 0) {
+		arena_alloc(&a, ARENA_CHUNK_SIZE);
+	} else {
+		stopped = true;
+	}
+	check(stopped && a.chunk_bytes <= a.limit, "mem: limit");
+
+	// the last chunk gets what is left
+	arena_alloc(&a, a.current->size - a.current->used);
+	arena_alloc(&a, 500);
+	check(a.chunk_bytes == a.limit, "mem: limit fills up");
+
+	arena_reset(&a);
+	check(a.used == 0 && a.total == 0 && a.peak == 0
+		&& a.chunk_bytes <= a.limit, "mem: reset");
+	arena_free(&a);
+	check(a.limit == ARENA_CHUNK_SIZE + 1000, "mem: free keeps the limit");
+
+	check(rt_set_mem_limit("64k") && ctx.mem_limit == 64 * 1024
+		&& rt_set_mem_limit("2G\n") && ctx.mem_limit == 2UL << 30
+		&& rt_set_mem_limit("0") && ctx.mem_limit == 0
+		&& !rt_set_mem_limit("-1") && !rt_set_mem_limit("1x")
+		&& !rt_set_mem_limit(""), "mem: sizes");
+
+	jmp_buf env;
+	memcpy(env, ctx.eval_env, sizeof(jmp_buf));
+
+	eval_pnc_expr("(+ 100000000000000000000 100000000000000000000)");
+	MemStats m = ctx.mem_last;
+	check(m.front_bytes > 0 && m.front_bytes <= m.arena_total
+		&& m.arena_peak <= m.arena_total
+		&& m.gmp_peak > 0 && m.gmp_peak <= m.gmp_total,
+		"mem: stats of an evaluation");
+
+	eval_pnc_expr(":mem");
+	check(memcmp(&m, &ctx.mem_last, sizeof(m)) == 0,
+		"mem: directives do not count");
+
+	// the product needs about 90k, printing it would take even more
+	rt_set_mem_limit("64k");
+	eval_pnc_expr("(prod (range 1 50000))");
+	check(ctx.mem_last.arena_peak < 64 * 1024,
+		"mem: limit stops an evaluation");
+
+	// the limbs of the fib memo and of the threads are on the heap, the
+	// memo is not even started and the threads give up early
+	rt_set_mem_limit("1m");
+	eval_pnc_expr("(fib 100000000)");
+	check(ctx.mem_last.gmp_peak < 1024 * 1024, "mem: limit stops fib");
+
+	// all of it would take about 18m
+	int saved = pool_size();
+	pool_init(8);
+	rt_set_mem_limit("4m");
+	eval_pnc_expr("(prod (range 1 1000000))");
+	check(ctx.mem_last.heap_peak > 0
+		&& ctx.mem_last.heap_peak < 6 * 1024 * 1024
+		&& atomic_load(&ctx.mem_heap_bytes) <= 0,
+		"mem: limit stops the threads");
+	pool_init(saved);
+
+	// a gmp call over the limit returns, only the flag is set
+	ctx.arena.limit = ctx.mem_limit;
+	atomic_store(&ctx.mem_exceeded, false);
+	ctx.gmp_use_arena = true;
+	mpz_t big;
+	mpz_init_set_ui(big, 1);
+	mpz_mul_2exp(big, big, 64 * 1024 * 1024);
+	check(atomic_load(&ctx.mem_exceeded) && mpz_sizeinbase(big, 2)
+		== 64 * 1024 * 1024 + 1, "mem: gmp is not cut short");
+	eval_cleanup();
+	rt_set_mem_limit("0");
+	arena_free(&ctx.arena);
+
+	memcpy(ctx.eval_env, env, sizeof(jmp_buf));
+}
+
+static void test_explain() {
+	Expr* e = parse_str("(+ (+ 1 2)  (sum (list 1/2 0.5)))");
+	dstr s = dstr_new();
+	expr_write(&s, e);
+	check(strcmp(s.data, "(+ (+ 1 2) (sum (list 1/2 5.0000000000000000e-1)))")
+		== 0, "explain: expr_write");
+	dstr_free(s);
+	arena_reset(&ctx.arena);
+
+	char* deep = gen_deep(200000);
+	e = parse_str(deep);
+	s = dstr_new();
+	expr_write(&s, e);
+	check(strcmp(s.data, deep) == 0, "explain: expr_write deep");
+	dstr_free(s);
+	arena_reset(&ctx.arena);
+
+	dstr_clear(ctx.out);
+	explain("(+ (+ 1 2) (sum (list 1/2 1/2)))", false);
+	check(strncmp(ctx.out.data, "= 4\n= incl_us", 13) == 0
+		&& strstr(ctx.out.data, " integer:small 1   (+\n") != NULL
+		&& strstr(ctx.out.data, " list:2items 2     (list\n") != NULL
+		&& strstr(ctx.out.data, " rational:1/1limbs 3       1/2\n") != NULL,
+		"explain: tree");
+	arena_reset(&ctx.arena);
+
+	// small integers need no memory, the bookkeeping must not show up
+	dstr_clear(ctx.out);
+	explain("(+ 1 (+ 2 3))", false);
+	check(strstr(ctx.out.data, " 0 0 0 0 integer:small 0 (+\n") != NULL
+		&& strstr(ctx.out.data, " 0 0 0 0 integer:small 1   (+\n") != NULL,
+		"explain: only the evaluation is measured");
+	arena_reset(&ctx.arena);
+
+	// one line per node, small enough to stay in ctx.out
+	free(deep);
+	deep = gen_deep(100);
+	dstr_clear(ctx.out);
+	explain(deep, true);
+	int lines = 0;
+	unsigned long long sum = 0;
+	for (char* line = ctx.out.data; *line != '\0'; line++) {
+		char* space = strchr(line, ' ');
+		sum += strtoull(space + 1, &line, 10);
+		lines++;
+	}
+	check(lines == 2 * 100 + 1 && strncmp(ctx.out.data, "+ ", 2) == 0,
+		"explain: folded");
+	check(sum > 0, "explain: folded times");
+
+	dstr_clear(ctx.out);
+	explain(deep, true);
+	check(strstr(ctx.out.data, ";...;") == NULL
+		&& strstr(ctx.out.data, ";... ") != NULL, "explain: folded depth");
+	dstr_clear(ctx.out);
+	arena_reset(&ctx.arena);
+	free(deep);
+}
+
+int main() {
+	mpfr_set_default_rounding_mode(MPFR_RNDN);
+	rt_init();
+
+	if (setjmp(ctx.eval_env) != 0) {
+		out_flush();
+		printf("FAIL unexpected error\n");
+		return 1;
+	}
+
+	test_deep_nesting();
+	test_small_int_overflow();
+	test_gmp_arena();
+	test_add_into();
+	test_range();
+	test_fib_memo();
+	test_list_layout();
+	test_simd_kernels();
+	test_tree_reduce();
+	test_bucketed_sum();
+	test_constants();
+	test_literals();
+	test_print();
+	test_timing();
+	test_profile();
+	test_mem();
+	test_explain();
+
+	return failures == 0 ? 0 : 1;
+}